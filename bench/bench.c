@@ -0,0 +1,232 @@
+/*
+Benchmark driver. Assembles a file a number of times and prints the best time of
+each phase with its throughput:
+
+  bench file [--iterations=N] [--threads=N] [--single-pass] [--format=hex|bin|obj|sobj] [--numbers]
+        [--scanner=scalar|sse2|avx2]
+
+Pair it with benchgen to get programs of any size, or run the bench build target.
+--scanner makes the lexer classify lines with that kernel instead of the fastest
+one the CPU has. --numbers also times parsing every # and x operand of the file
+with parseNumber against the libc way toNum used to do it, try it on an immediate
+heavy --mix.
+*/
+#include <limits.h>
+#include "assembler.h"
+#include "scan.h"
+
+// The old toNum: copy out the token, check its digits, then have atoi or strtol convert it
+static bool libcNumber(token num, int* value){
+    char text[64];
+    if (num.len >= sizeof(text)){
+        return false;
+    }
+    memcpy(text, num.ptr, num.len);
+    text[num.len] = '\0';
+    char* pStr = text[0] == '0' ? text + 1 : text;
+    bool hex = *pStr == 'x' || *pStr == 'X';
+    if (*pStr != '#' && !hex){
+        return false;
+    }
+    pStr++;
+    bool negative = *pStr == '-';
+    if (negative){
+        pStr++;
+    }
+    for (size_t i = 0; i < strlen(pStr); ++i){
+        if (hex ? !isxdigit((unsigned char)pStr[i]) : !isdigit((unsigned char)pStr[i])){
+            return false;
+        }
+    }
+    long number = hex ? strtol(pStr, NULL, 16) : atoi(pStr);
+    int result = number > INT_MAX ? INT_MAX : (int)number;
+    *value = negative ? -result : result;
+    return true;
+}
+
+// Best time of iterations runs of parsing every number, libc picks libcNumber over parseNumber
+static double timeNumbers(const token* numbers, size_t count, int iterations, bool libc, long* sum){
+    double best = 0;
+    for (int run = 0; run < iterations; ++run){
+        double start = stats_now();
+        long total = 0;
+        for (size_t i = 0; i < count; ++i){
+            int value = 0;
+            if (libc){
+                libcNumber(numbers[i], &value);
+            } else {
+                parseNumber(numbers[i], &value);
+            }
+            total += value;
+        }
+        double seconds = stats_now() - start;
+        if (run == 0 || seconds < best){
+            best = seconds;
+        }
+        *sum = total;
+    }
+    return best;
+}
+
+// Time parsing the number operands of input both ways, after the phases
+static bool benchNumbers(source* input, int iterations){
+    size_t count = 0, capacity = 1024, bytes = 0;
+    token* numbers = malloc(capacity * sizeof(token));
+    if (numbers == NULL){
+        return false;
+    }
+    rewindSource(input);
+    token label, opcode, args[4];
+    int opcodeId;
+    while (readAndParse(input, &label, &opcode, &args[0], &args[1], &args[2], &args[3], &opcodeId) != DONE){
+        for (int i = 0; i < 4; ++i){
+            size_t start = tokenAt(args[i], 0) == '0' ? 1 : 0;
+            if (tokenAt(args[i], start) != '#' && LOWER(tokenAt(args[i], start)) != 'x'){
+                continue;
+            }
+            if (count == capacity){
+                token* grown = realloc(numbers, 2 * capacity * sizeof(token));
+                if (grown == NULL){
+                    free(numbers);
+                    return false;
+                }
+                numbers = grown;
+                capacity *= 2;
+            }
+            numbers[count++] = args[i];
+            bytes += args[i].len;
+        }
+    }
+
+    long sum, libcSum;
+    double seconds = timeNumbers(numbers, count, iterations, false, &sum);
+    double libcSeconds = timeNumbers(numbers, count, iterations, true, &libcSum);
+    printf("\n%zu numbers, %zu bytes%s\n", count, bytes, sum == libcSum ? "" : ", PARSED DIFFERENTLY");
+    printf("%-12s %10s %14s %10s\n", "parser", "ms", "numbers/s", "MB/s");
+    seconds = seconds > 0 ? seconds : 1e-9;
+    libcSeconds = libcSeconds > 0 ? libcSeconds : 1e-9;
+    printf("%-12s %10.3f %14.0f %10.1f\n", "parseNumber", seconds * 1000, count / seconds, bytes / seconds / 1e6);
+    printf("%-12s %10.3f %14.0f %10.1f\n", "libc", libcSeconds * 1000, count / libcSeconds, bytes / libcSeconds / 1e6);
+    free(numbers);
+    return true;
+}
+
+int main(int argc, char** argv){
+    const char* path = NULL;
+    int iterations = 10;
+    asm_options options = {0};
+    bool numbers = false;
+
+    for (int i = 1; i < argc; ++i){
+        const char* arg = argv[i];
+        if (strncmp(arg, "--iterations=", 13) == 0){
+            iterations = atoi(arg + 13);
+        } else if (strncmp(arg, "--threads=", 10) == 0){
+            options.threads = atoi(arg + 10);
+        } else if (strcmp(arg, "--single-pass") == 0){
+            options.passMode = SINGLE_PASS;
+        } else if (strncmp(arg, "--scanner=", 10) == 0){
+            if (!scan_use(scan_find_kernel(arg + 10))){
+                fprintf(stderr, "Scanner %s isn't available\n", arg + 10);
+                return 1;
+            }
+        } else if (strcmp(arg, "--numbers") == 0){
+            numbers = true;
+        } else if (strncmp(arg, "--format=", 9) == 0){
+            options.format = findFormat(arg + 9);
+            if (options.format < 0){
+                fprintf(stderr, "Unknown format %s\n", arg + 9);
+                return 1;
+            }
+        } else if (arg[0] != '-' && path == NULL){
+            path = arg;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return 1;
+        }
+    }
+    if (path == NULL || iterations < 1){
+        fprintf(stderr, "Usage: %s file [--iterations=N] [--threads=N] [--single-pass] [--format=hex|bin|obj|sobj] [--numbers] [--scanner=KERNEL]\n", argv[0]);
+        return 1;
+    }
+
+    source input;
+    if (!openSource(&input, path)){
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    asm_workspace* ws = asm_workspace_create();
+    image* output = image_create();
+    FILE* sink = tmpfile();
+    diag_list diags;
+    diag_init(&diags);
+    if (ws == NULL || output == NULL || sink == NULL){
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    asm_stats best;
+    double bestTotal = 0;
+    for (int run = 0; run < iterations; ++run){
+        asm_stats stats = {0};
+        options.stats = &stats;
+        rewindSource(&input);
+        image_clear(output);
+        if (!assembleWith(ws, &input, &options, output, &diags)){
+            fprintf(stderr, "%s:%d: %s\n", path, diags.items[0].line, diags.items[0].message);
+            return diags.items[0].code;
+        }
+
+        // output phase: format the image into a scratch file
+        rewind(sink);
+        double start = stats_now();
+        if (!writeImage(output, sink, options.format)){
+            fprintf(stderr, "Failed to write the output\n");
+            return 1;
+        }
+        fflush(sink);
+        stats.seconds[PHASE_OUTPUT] = stats_now() - start;
+        stats.lines[PHASE_OUTPUT] = image_size(output);
+        stats.bytes[PHASE_OUTPUT] = (size_t)ftell(sink);
+
+        double total = 0;
+        for (int phase = 0; phase < NUM_PHASES; ++phase){
+            total += stats.seconds[phase];
+        }
+        if (run == 0){
+            best = stats;
+            bestTotal = total;
+            continue;
+        }
+        for (int phase = 0; phase < NUM_PHASES; ++phase){
+            if (stats.seconds[phase] < best.seconds[phase]){
+                best.seconds[phase] = stats.seconds[phase];
+            }
+        }
+        if (total < bestTotal){
+            bestTotal = total;
+        }
+    }
+
+    printf("%s: %zu bytes, %zu words, best of %d, %s scanner\n", path, input.size, image_size(output), iterations,
+        scan_kernel_name(scan_kernel()));
+    printf("%-12s %10s %14s %10s\n", "phase", "ms", "lines/s", "MB/s");
+    for (int phase = 0; phase < NUM_PHASES; ++phase){
+        double seconds = best.seconds[phase] > 0 ? best.seconds[phase] : 1e-9;
+        printf("%-12s %10.3f %14.0f %10.1f\n", phaseName(phase), best.seconds[phase] * 1000,
+            best.lines[phase] / seconds, best.bytes[phase] / seconds / 1e6);
+    }
+    printf("%-12s %10.3f %14.0f %10.1f\n", "total", bestTotal * 1000,
+        countLines(&input) / bestTotal, input.size / bestTotal / 1e6);
+    if (numbers && !benchNumbers(&input, iterations)){
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    fclose(sink);
+    diag_free(&diags);
+    image_destroy(output);
+    asm_workspace_destroy(ws);
+    closeSource(&input);
+    return 0;
+}
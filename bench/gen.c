@@ -0,0 +1,324 @@
+/*
+Synthetic program generator for the benchmarks. Writes a program that assembles
+without errors, shaped by the options:
+
+  --lines=N       lines between .orig and .end (default 100000)
+  --labels=F      fraction of instructions that define a label (default 0.2)
+  --comments=F    fraction of comment only lines, as many instructions also get a
+                  trailing comment (default 0.1)
+  --blkw=N        largest .blkw size in words (default 8)
+  --stringz=N     longest .stringz string (default 16)
+  --mix=SPEC      opcode weights, e.g. "add:4,ldw:2,br:1". Opcodes that aren't named
+                  get weight 0. By default every opcode but .orig and .end has weight 1
+  --seed=N        random seed (default 1)
+  --output=PATH   file to write, stdout if not given
+*/
+#include "fileFunctions.h"
+
+#define ORIG_ADDRESS 0x3000
+#define LABEL_WINDOW 64 // lines either side searched for a label in range
+
+// One line of the generated program, planned before any text is written
+typedef struct {
+    int opcode;     // NUM_OPCODES for a comment only line
+    int label;      // label defined on the line, -1 if none
+    int size;       // .blkw words or .stringz characters
+    int address;    // address of the label defined here, as the first pass sees it
+    int location;   // location the second pass encodes the line at
+    bool trailing;  // instruction followed by a comment
+} gen_line;
+
+static uint64_t rngState;
+
+// xorshift64*, good enough for shaping test programs
+static uint64_t nextRandom(void){
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return rngState * 2685821657736338717ULL;
+}
+
+static int randomBelow(int n){
+    return (int)(nextRandom() % (uint64_t)n);
+}
+
+static double randomUnit(void){
+    return (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Parse "name:weight,..." into weights, return false on an unknown name
+static bool parseMix(const char* spec, double* weights){
+    for (int i = 0; i < NUM_OPCODES; ++i){
+        weights[i] = 0;
+    }
+    while (*spec != '\0'){
+        const char* colon = strchr(spec, ':');
+        if (colon == NULL){
+            return false;
+        }
+        int opcode = lookupOpcode(spec, colon - spec);
+        if (opcode == NUM_OPCODES || opcode == ORIG || opcode == END){
+            fprintf(stderr, "Unknown opcode %.*s in --mix\n", (int)(colon - spec), spec);
+            return false;
+        }
+        char* end;
+        weights[opcode] = strtod(colon + 1, &end);
+        spec = *end == ',' ? end + 1 : end;
+    }
+    return true;
+}
+
+// Pick an opcode with probability proportional to its weight
+static int pickOpcode(const double* weights, double total){
+    double r = randomUnit() * total;
+    int last = ADD;
+    for (int i = 0; i < NUM_OPCODES; ++i){
+        if (weights[i] > 0){
+            last = i;
+            if (r < weights[i]){
+                return i;
+            }
+            r -= weights[i];
+        }
+    }
+    return last;
+}
+
+// Return the label operand kind of an opcode, 0 if it takes no label
+static int labelKind(int opcode){
+    switch (opcode){
+        case LDI: case LDIB:
+            return 1; // unsigned 8 bit offset
+        case LEA: case STI: case STIB:
+        case BR: case BRN: case BRNZ: case BRNP: case BRNZP: case BRZP: case BRZ: case BRP:
+            return 2; // signed 8 bit offset
+        case JSR:
+            return 3; // signed 11 bit offset
+        default:
+            return 0;
+    }
+}
+
+/*
+Return true if an instruction of the given kind at location can reach address.
+Mirrors the arithmetic of the encoders, including the 16 bit wrap of addresses.
+*/
+static bool inRange(int kind, int address, int location){
+    int offset = ((int16_t)(uint16_t)address - location) / 2;
+    switch (kind){
+        case 1: { int value = (uint16_t)offset; return value <= 127; }
+        case 2: { int value = (int16_t)offset; return value >= -128 && value <= 127; }
+        case 3: { int value = (int16_t)offset; return value >= -1024 && value <= 1023; }
+        default: return false;
+    }
+}
+
+// Find a label the instruction on line i can reach, return its line or -1
+static int findTarget(const gen_line* lines, int count, int i, int kind){
+    int lo = i - LABEL_WINDOW > 0 ? i - LABEL_WINDOW : 0;
+    int hi = i + LABEL_WINDOW < count ? i + LABEL_WINDOW : count - 1;
+    for (int attempt = 0; attempt < 8; ++attempt){
+        int j = lo + randomBelow(hi - lo + 1);
+        if (lines[j].label >= 0 && inRange(kind, lines[j].address, lines[i].location)){
+            return j;
+        }
+    }
+    for (int j = i; j <= hi; ++j){
+        if (lines[j].label >= 0 && inRange(kind, lines[j].address, lines[i].location)){
+            return j;
+        }
+    }
+    return -1;
+}
+
+static char upper(char c){
+    return (c >= 'a' && c <= 'z') ? c - 32 : c;
+}
+
+static void writeOpcode(FILE* out, int opcode){
+    for (const char* p = opcodeName(opcode); *p != '\0'; ++p){
+        fputc(upper(*p), out);
+    }
+}
+
+static int reg(void){
+    return randomBelow(8);
+}
+
+// Write the operands of an instruction that doesn't reference a label
+static void writeOperands(FILE* out, const gen_line* line){
+    switch (line->opcode){
+        case ADD: case AND: case OR: case XOR: case MUL: case DIV:
+            if (randomBelow(2)){
+                fprintf(out, " R%d, R%d, R%d", reg(), reg(), reg());
+            } else {
+                fprintf(out, " R%d, R%d, #%d", reg(), reg(), randomBelow(8));
+            }
+            break;
+        case LDB: case LDW: case ROT:
+            fprintf(out, " R%d, R%d, #%d", reg(), reg(), randomBelow(32));
+            break;
+        case STB: case STW: case LSHF: case RSHFL: case RSHFA: case EXTW:
+            fprintf(out, " R%d, R%d, #%d", reg(), reg(), randomBelow(8));
+            break;
+        case EXTB:
+            fprintf(out, " R%d, R%d, #%d", reg(), reg(), randomBelow(16));
+            break;
+        case MACC:
+            fprintf(out, " R%d, R%d, R%d, #%d", reg(), reg(), reg(), randomBelow(4));
+            break;
+        case MOV:
+            fprintf(out, " R%d, R%d", reg(), reg());
+            break;
+        case JMP: case JSRR: case PUSH: case PUSHB: case POP: case POPB:
+            fprintf(out, " R%d", reg());
+            break;
+        case TRAP:
+            fprintf(out, " x%02X", 0x20 + randomBelow(6));
+            break;
+        case FILL:
+            fprintf(out, " x%04X", randomBelow(0x10000));
+            break;
+        case BLKW:
+            fprintf(out, " #%d", line->size);
+            break;
+        case STRINGZ: {
+            static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+            fputc(' ', out);
+            for (int i = 0; i < line->size; ++i){
+                fputc(alphabet[randomBelow(sizeof(alphabet) - 1)], out);
+            }
+            break;
+        }
+        default: // ret, rti, halt
+            break;
+    }
+}
+
+int main(int argc, char** argv){
+    int count = 100000, maxBlkw = 8, maxStringz = 16;
+    double labelRatio = 0.2, commentRatio = 0.1;
+    double weights[NUM_OPCODES];
+    const char* outputPath = NULL;
+    rngState = 1;
+
+    for (int i = 0; i < NUM_OPCODES; ++i){
+        weights[i] = (i == ORIG || i == END) ? 0 : 1;
+    }
+    for (int i = 1; i < argc; ++i){
+        const char* arg = argv[i];
+        if (strncmp(arg, "--lines=", 8) == 0){
+            count = atoi(arg + 8);
+        } else if (strncmp(arg, "--labels=", 9) == 0){
+            labelRatio = atof(arg + 9);
+        } else if (strncmp(arg, "--comments=", 11) == 0){
+            commentRatio = atof(arg + 11);
+        } else if (strncmp(arg, "--blkw=", 7) == 0){
+            maxBlkw = atoi(arg + 7);
+        } else if (strncmp(arg, "--stringz=", 10) == 0){
+            maxStringz = atoi(arg + 10);
+        } else if (strncmp(arg, "--mix=", 6) == 0){
+            if (!parseMix(arg + 6, weights)){
+                return 1;
+            }
+        } else if (strncmp(arg, "--seed=", 7) == 0){
+            rngState = strtoull(arg + 7, NULL, 10) * 0x9E3779B97F4A7C15ULL + 1;
+        } else if (strncmp(arg, "--output=", 9) == 0){
+            outputPath = arg + 9;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return 1;
+        }
+    }
+    double total = 0;
+    for (int i = 0; i < NUM_OPCODES; ++i){
+        total += weights[i];
+    }
+    if (count < 1 || total <= 0 || maxBlkw < 1 || maxStringz < 1){
+        fprintf(stderr, "Nothing to generate, check --lines, --mix, --blkw and --stringz\n");
+        return 1;
+    }
+
+    gen_line* lines = calloc(count, sizeof(gen_line));
+    if (lines == NULL){
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // plan the lines and work out addresses the way both passes will
+    int labels = 0, firstOffset = 0, secondOffset = 0;
+    for (int i = 0; i < count; ++i){
+        gen_line* line = &lines[i];
+        line->label = -1;
+        secondOffset += 2;
+        line->location = ORIG_ADDRESS + secondOffset;
+        if (randomUnit() < commentRatio){
+            line->opcode = NUM_OPCODES;
+            continue;
+        }
+        line->opcode = pickOpcode(weights, total);
+        line->trailing = randomUnit() < commentRatio;
+        if (randomUnit() < labelRatio){
+            line->label = labels++;
+        }
+        line->address = ORIG_ADDRESS + firstOffset;
+        if (line->opcode == BLKW){
+            line->size = 1 + randomBelow(maxBlkw);
+            firstOffset += line->size * 2;
+            secondOffset += line->size * 2;
+        } else if (line->opcode == STRINGZ){
+            line->size = 1 + randomBelow(maxStringz);
+            firstOffset += (line->size + 1) & ~1;
+            secondOffset += ((line->size + 1) / 2) * 2;
+        } else {
+            firstOffset += 2;
+        }
+    }
+
+    FILE* out = outputPath != NULL ? fopen(outputPath, "w") : stdout;
+    if (out == NULL){
+        fprintf(stderr, "Cannot create %s\n", outputPath);
+        free(lines);
+        return 1;
+    }
+    fprintf(out, "\t.ORIG x%04X\n", ORIG_ADDRESS);
+    for (int i = 0; i < count; ++i){
+        gen_line* line = &lines[i];
+        if (line->opcode == NUM_OPCODES){
+            fputs("; generated filler comment\n", out);
+            continue;
+        }
+        if (line->label >= 0){
+            fprintf(out, "L%d", line->label);
+        }
+        fputc('\t', out);
+
+        int kind = labelKind(line->opcode);
+        int target = kind != 0 ? findTarget(lines, count, i, kind) : -1;
+        if (kind != 0 && target < 0){
+            // nothing in reach, fall back to an instruction without a label
+            fprintf(out, "ADD R%d, R%d, R%d", reg(), reg(), reg());
+        } else if (kind != 0){
+            writeOpcode(out, line->opcode);
+            if (kind == 3 || line->opcode >= BR){
+                fprintf(out, " L%d", lines[target].label);
+            } else {
+                fprintf(out, " R%d, L%d", reg(), lines[target].label);
+            }
+        } else {
+            writeOpcode(out, line->opcode);
+            writeOperands(out, line);
+        }
+        if (line->trailing){
+            fputs(" ; trailing comment", out);
+        }
+        fputc('\n', out);
+    }
+    fputs("\t.END\n", out);
+
+    if (out != stdout){
+        fclose(out);
+    }
+    free(lines);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "stdint.h"
+
+// Bump allocator: create with arena_create, free everything at once with arena_destroy.
+// Memory is handed out from large blocks and never freed individually.
+typedef struct arena arena;
+
+//create empty arena and return pointer to it, or NULL if out of memory.
+arena* arena_create(void);
+
+//Free the arena along with everything allocated from it
+void arena_destroy(arena* a);
+
+//Allocate size bytes aligned for any type, return NULL if out of memory.
+void* arena_alloc(arena* a, size_t size);
+
+//Same as arena_alloc but the memory is zeroed
+void* arena_calloc(arena* a, size_t size);
+
+//Free everything allocated from the arena but keep its first block for reuse
+void arena_reset(arena* a);
+
+#endif
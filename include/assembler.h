@@ -1,11 +1,84 @@
-
-
-#ifndef ASSEMBLER_H
-#define ASSEMBLER_H
-#include "fileFunctions.h"
-#include "ht.h"
-
-void assemble(const char* inputFile,const char* outputFile);
-
-
+
+
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+#include "fileFunctions.h"
+#include "ht.h"
+#include "symtab.h"
+#include "image.h"
+#include "output.h"
+#include "diag.h"
+#include "stats.h"
+#include "cache.h"
+
+// Version of the encoder, bump it whenever the same source would assemble differently
+// so cached images from older versions aren't used
+#define ASSEMBLER_VERSION "1.1"
+
+	enum
+	{
+	   TWO_PASS, SINGLE_PASS
+	};
+
+// Options for assemble, zero initialised options give the defaults
+typedef struct {
+	int passMode; // TWO_PASS or SINGLE_PASS
+	int format;   // FORMAT_HEX, FORMAT_BIN, FORMAT_OBJ or FORMAT_SOBJ
+	int threads;  // threads lexing and running both passes, 0 uses every core
+	asm_stats* stats; // filled in with the time of each phase, NULL to skip timing
+	const char* cacheDir; // directory of cached images to reuse and add to, NULL for no cache
+} asm_options;
+
+// Label table, buffers and threads that can be reused across assemblies:
+// create with asm_workspace_create, free with asm_workspace_destroy
+typedef struct asm_workspace asm_workspace;
+
+//create workspace and return pointer to it, or NULL if out of memory.
+asm_workspace* asm_workspace_create(void);
+
+void asm_workspace_destroy(asm_workspace* ws);
+
+/*
+Assemble the source into output, setting its origin and appending its words. Errors
+are added to diags, return false if there were any. There is no global state, so
+this can be called from several threads at once with different arguments.
+*/
+bool assembleSource(source* input, const asm_options* options, image* output, diag_list* diags);
+
+/*
+Same as assembleSource but with the tables and buffers of the given workspace, which
+saves allocating them again for every source. A workspace is used by one thread at a time.
+*/
+bool assembleWith(asm_workspace* ws, source* input, const asm_options* options, image* output, diag_list* diags);
+
+//Same as assembleSource for size bytes of source text held in memory
+bool assembleBuffer(const char* text, size_t size, const asm_options* options, image* output, diag_list* diags);
+
+/*
+Source held line by line for edit and assemble loops: create with asm_document_create,
+free with asm_document_destroy. An edit re-parses only the lines it inserts and
+re-encodes only the instructions it affects, the image is always the same as a full
+assembly of the document's text. Each line of the text is followed by '\n'.
+*/
+typedef struct asm_document asm_document;
+
+//create empty document and return pointer to it, or NULL if out of memory.
+asm_document* asm_document_create(const asm_options* options);
+
+void asm_document_destroy(asm_document* doc);
+
+//return number of lines in the document
+size_t asm_document_lines(asm_document* doc);
+
+/*
+Replace removed lines starting at line first (counting from 0) with the lines of size
+bytes of text, then write the image of the whole document into output. Text ending
+in '\n' doesn't add an empty line after it, empty text only removes lines. Errors are
+added to diags, reported as a full assembly of the text would, return false if there
+were any. Load a file by inserting all of it at line 0 of an empty document.
+*/
+bool asm_document_edit(asm_document* doc, size_t first, size_t removed, const char* text, size_t size,
+    image* output, diag_list* diags);
+
+
 #endif
\ No newline at end of file
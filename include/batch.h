@@ -0,0 +1,15 @@
+#ifndef BATCH_H
+#define BATCH_H
+#include "assembler.h"
+
+/*
+Assemble many inputs in one process, without prompting. Each argument is a source
+file, a directory (every .asm file in it), a wildcard pattern or @file naming a
+response file with one input per line. Sources are assembled in parallel on
+options->threads threads (0 for every core) and each output is written next to its
+input, or into outDir if it isn't NULL, with the extension of the output format.
+Errors are printed per file along with the overall throughput. Return the exit status.
+*/
+int runBatch(char** args, int count, const asm_options* options, const char* outDir);
+
+#endif
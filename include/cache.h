@@ -0,0 +1,38 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "image.h"
+
+/*
+On-disk cache of assembled images. Each entry is a file in the cache directory named
+after the key, which hashes the source bytes and the assembler version. Entries are
+written to a temporary file and renamed into place, so any number of processes can
+share a directory. Cache files are in host byte order and meant for one machine.
+*/
+
+// Cache key, 128 bits so unrelated sources don't collide in practice
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} cache_key;
+
+//Return the key for size bytes of source assembled by the given version of the assembler
+cache_key cache_hash(const char* data, size_t size, const char* version);
+
+/*
+Append the words and regions cached under key to output and set its origin. Return
+false if there is no entry or it can't be read, output is left alone then.
+*/
+bool cache_load(const char* dir, cache_key key, size_t sourceSize, image* output);
+
+/*
+Store the words of img from index first on and its regions from index firstRegion
+on under key, creating dir if needed. Return false if the entry couldn't be written,
+the cache is only ever a shortcut so callers can ignore that.
+*/
+bool cache_store(const char* dir, cache_key key, size_t sourceSize, const image* img, size_t first, size_t firstRegion);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define DIAG_MESSAGE_LENGTH 160
+
+// A single assembly error
+typedef struct {
+    int code;  // exit status the command line tool terminates with
+    int line;  // source line the error was found on, 0 if it isn't tied to a line
+    char message[DIAG_MESSAGE_LENGTH];
+} diagnostic;
+
+// Errors collected while assembling: set up with diag_init, free with diag_free
+typedef struct {
+    diagnostic* items;
+    size_t length;   // number of items
+    size_t capacity; // size of items array
+    size_t errors;   // number of reported errors, including any dropped for lack of memory
+    int line;        // line currently being assembled, stamped on new diagnostics
+} diag_list;
+
+void diag_init(diag_list* list);
+
+void diag_free(diag_list* list);
+
+/*
+Record an error with a printf style message. Always returns false so a check
+can end with "return diag_report(...)".
+*/
+bool diag_report(diag_list* list, int code, const char* format, ...);
+
+//Move every diagnostic in src to the end of dst, src is left empty
+void diag_append(diag_list* dst, diag_list* src);
+
+//Return true if any error has been reported
+static inline bool diag_failed(const diag_list* list){
+    return list->errors > 0;
+}
+
+#endif
@@ -1,86 +1,149 @@
-
-#ifndef FILEFUNCTIONS_H
-#define FILEFUNCTIONS_H
-#include <string.h>
-#include <stdio.h>
-#include <stdint.h>
-#include <stdlib.h>
-#include <ctype.h>
-#include <stdbool.h>
-#include "ht.h"
-#define MAX_LINE_LENGTH 255
-
-
-	enum
-	{
-	   DONE, OK, EMPTY_LINE
-	};
-
-	enum {
-ADD,
-AND,
-OR,
-XOR,
-LDB,
-LDW,
-LDI,
-LDIB,
-LEA,
-STB,
-STW,
-STI,
-STIB,
-BR,
-BRN,
-BRNZ,
-BRNP,
-BRNZP,
-BRZP,
-BRZ,
-BRP,
-JMP,
-JSR,
-JSRR,
-RET,
-RTI,
-MUL,
-DIV,
-TRAP,
-LSHF,
-RSHFL,
-RSHFA,
-MOV,
-ROT,
-PUSH,
-PUSHB,
-POP,
-POPB,
-MACC,
-EXTB,
-EXTW,
-HALT,
-FILL,
-BLKW,
-STRINGZ,
-END,
-ORIG,
-NUM_OPCODES,
-};
-
-
-void obtainFilePath(char* inputFile, char* outputFile, uint16_t maxsize);
-
-int readAndParse( FILE* pInfile, char* pLine, char** pLabel, char
-	** pOpcode, char** pArg1, char** pArg2, char** pArg3, char** pArg4
-	);
-
-int toNum(char* pStr);
-
-bool isOpcode(const char* inputString);
-
-int findOpcode(const char* inputString);
-
-char toHexString(uint8_t input);
-
-
+
+#ifndef FILEFUNCTIONS_H
+#define FILEFUNCTIONS_H
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include "ht.h"
+#include "diag.h"
+
+
+	enum
+	{
+	   DONE, OK, EMPTY_LINE
+	};
+
+	enum {
+ADD,
+AND,
+OR,
+XOR,
+LDB,
+LDW,
+LDI,
+LDIB,
+LEA,
+STB,
+STW,
+STI,
+STIB,
+BR,
+BRN,
+BRNZ,
+BRNP,
+BRNZP,
+BRZP,
+BRZ,
+BRP,
+JMP,
+JSR,
+JSRR,
+RET,
+RTI,
+MUL,
+DIV,
+TRAP,
+LSHF,
+RSHFL,
+RSHFA,
+MOV,
+ROT,
+PUSH,
+PUSHB,
+POP,
+POPB,
+MACC,
+EXTB,
+EXTW,
+HALT,
+FILL,
+BLKW,
+STRINGZ,
+END,
+ORIG,
+NUM_OPCODES,
+};
+
+
+// A token of the source, points straight into the mapped file and isn't NUL-terminated
+typedef struct {
+	const char* ptr;
+	size_t len;
+} token;
+
+// printf helpers for tokens: printf("label " TOKEN_FMT, TOKEN_ARG(t))
+#define TOKEN_FMT "%.*s"
+#define TOKEN_ARG(t) (int)(t).len, (t).ptr
+
+// Lowercase an ASCII character, anything else is returned unchanged
+#define LOWER(c) (((c) >= 'A' && (c) <= 'Z') ? ((c) | 0x20) : (c))
+
+// Copy the token lowercased into buffer of the given size, cut short if it doesn't fit, and return
+// buffer. Messages show tokens this way, the way lexing used to leave them
+const char* lowerToken(token t, char* buffer, size_t size);
+
+// Return character i of the token lowercased, or '\0' past its end
+static inline char tokenAt(token t, size_t i){
+	return i < t.len ? LOWER(t.ptr[i]) : '\0';
+}
+
+// Return true if the token equals the lowercase string str, ignoring case
+bool tokenEquals(token t, const char* str);
+
+// Source file mapped into memory, open with openSource and close with closeSource
+typedef struct {
+	const char* data; // file contents
+	size_t size;      // number of bytes in data
+	size_t pos;       // offset of the next line to read
+	int line;         // number of lines read so far
+	bool mapped;      // data is a mapping rather than a heap copy
+	bool borrowed;    // data belongs to the caller, closeSource leaves it alone
+} source;
+
+// Map the file at path into memory, return false if it can't be opened
+bool openSource(source* pSource, const char* path);
+
+// Read from size bytes of text in memory, which must outlive the source
+void openBuffer(source* pSource, const char* data, size_t size);
+
+void closeSource(source* pSource);
+
+// Start reading from the first line again
+void rewindSource(source* pSource);
+
+// Return the number of lines in the source, a quick memchr scan
+size_t countLines(const source* pSource);
+
+int readAndParse( source* pSource, token* pLabel, token* pOpcode,
+	token* pArg1, token* pArg2, token* pArg3, token* pArg4,
+	int* pOpcodeId
+	);
+
+	enum
+	{
+	   NUM_OK,          // parsed
+	   NUM_BAD_DECIMAL, // # followed by something other than digits
+	   NUM_BAD_HEX,     // x followed by something other than hex digits
+	   NUM_BAD_OPERAND  // neither a # nor an x number
+	};
+
+// Parse a #decimal or xhex number, either may have a leading 0 and a - after the #
+// or x. Return NUM_OK and set value, or the reason it isn't a number and leave value alone
+int parseNumber(token num, int* value);
+
+// parseNumber, reporting the error to diags and returning 0 if it isn't a number
+int toNum(token num, diag_list* diags);
+
+//Return true if the token can be used as a label
+bool isValidLabel(token label);
+
+int lookupOpcode(const char* inputString, size_t length);
+
+//Return the lowercase name of an opcode, e.g. "add" or ".blkw", or NULL if out of range
+const char* opcodeName(int opcode);
+
+
 #endif
\ No newline at end of file
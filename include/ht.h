@@ -1,53 +1,117 @@
-#ifndef HT_H
-#define HT_H
-
-#include "stdlib.h"
-#include "stdbool.h"
-#include "stdint.h"
-
-// Hash table structure: create with ht_create, free with ht_destroy
-typedef struct ht ht;
-
-//create hash table and return pointer to it, or NULL if out of memory.
-ht* ht_create(void);
-
-//Free memory allocated for hash table, including allocated keys
-void ht_destroy(ht* table);
-
-//Get item with given key (NUL-terminated) from hash table. Return 
-//value (which was set with ht_set), or NULL if key not found.
-void* ht_get(ht* table, const char* key);
-
-/*
-set item with given key (NUL-terminated) to value (which must not
-be NULL). If not already present in table, key is copied to newly
-allocated memory (keys are freed automatically when ht_destroy is called).
-return address of copied key, or NULL if out of memory.
-*/
-const char* ht_set(ht* table, const char* key, void* value);
-
-//return number of items in hash table
-size_t ht_length(ht* table);
-
-//Hash table iterator (create with ht_iterator)
-typedef struct {
-    const char* key; // current key
-    void* value; // current value
-
-    ht* _table; //reference to hash table being iterated
-    size_t _index; // current index into ht._entries
-} hti;
-
-
-//Return new hash table iterator (for use with ht_next)
-hti ht_iterator(ht* table);
-
-/*
-Move iterator to next item in hash table, update iterator's key 
-and value to current item, and return true. If there are no more 
-items, return false. Don't call ht_set during iteration.
-*/
-bool ht_next(hti* it);
-
-
+#ifndef HT_H
+#define HT_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "arena.h"
+
+// Hash table structure: create with ht_create, free with ht_destroy.
+// Keys are ASCII case-insensitive, they are stored lowercased.
+typedef struct ht ht;
+
+//create hash table and return pointer to it, or NULL if out of memory.
+ht* ht_create(void);
+
+/*
+create hash table with room for expected items before it has to expand. Keys are
+copied into the arena if it isn't NULL, as with ht_create_arena. Return NULL if
+out of memory.
+*/
+ht* ht_create_with_capacity(size_t expected, arena* a);
+
+/*
+create hash table whose keys are copied into the given arena, which must outlive
+the table. ht_destroy then leaves keys and values alone, they go away with the
+arena. Return NULL if out of memory.
+*/
+ht* ht_create_arena(arena* a);
+
+//Free memory allocated for hash table, including allocated keys and values
+//unless the table was created with ht_create_arena
+void ht_destroy(ht* table);
+
+//Get item with given key (NUL-terminated) from hash table. Return 
+//value (which was set with ht_set), or NULL if key not found.
+void* ht_get(ht* table, const char* key);
+
+//Same as ht_get for a key of the given length that need not be NUL-terminated.
+void* ht_getn(ht* table, const char* key, size_t length);
+
+/*
+set item with given key (NUL-terminated) to value (which must not
+be NULL). If not already present in table, key is copied to newly
+allocated memory (keys are freed automatically when ht_destroy is called).
+return address of copied key, or NULL if out of memory.
+*/
+const char* ht_set(ht* table, const char* key, void* value);
+
+//Same as ht_set for a key of the given length that need not be NUL-terminated.
+const char* ht_setn(ht* table, const char* key, size_t length, void* value);
+
+//Same as ht_setn but value is stored inline in the table instead of pointed to.
+//Only for tables created with ht_create_arena.
+const char* ht_setn_int(ht* table, const char* key, size_t length, int value);
+
+//Get item set with ht_setn_int, return false if key not found.
+bool ht_getn_int(ht* table, const char* key, size_t length, int* value);
+
+//Return 64-bit FNV-1a hash for the first length characters of key, ignoring case
+uint64_t ht_hash(const char* key, size_t length);
+
+//return number of items in hash table
+size_t ht_length(ht* table);
+
+/*
+Set the fraction of slots that may be used before the table doubles, between 0.1
+and 0.9, 0.5 by default. Lower means shorter probes for more memory.
+*/
+void ht_set_max_load(ht* table, double load);
+
+/*
+Turn incremental expansion on or off, it's off by default. When on, expanding keeps
+the old slots next to the new ones and every later get and set moves a few of them
+over, so no single call pays for rehashing the whole table. Lookups probe both
+arrays until the move is done. Only ht has this mode, the label tables are symtabs,
+which are sized up front from the line count of the source instead.
+*/
+void ht_set_incremental(ht* table, bool incremental);
+
+#define HT_PROBE_BUCKETS 8
+
+// Shape of a hash table, filled in by ht_info
+typedef struct {
+    size_t length;     // number of items
+    size_t capacity;   // number of slots
+    size_t expansions; // times the slots were grown
+    size_t collisions; // items that aren't in their home slot
+    size_t max_probe;  // most slots a lookup of an item in the table reads
+    double mean_probe; // slots read by a lookup, averaged over every item
+    size_t probes[HT_PROBE_BUCKETS]; // items found after 1, 2, ... slots, the last counts the rest
+} ht_stats;
+
+//Fill in stats for the table. This walks every slot, so it's for tuning, not hot paths.
+void ht_info(ht* table, ht_stats* stats);
+
+//Hash table iterator (create with ht_iterator)
+typedef struct {
+    const char* key; // current key
+    void* value; // current value
+
+    ht* _table; //reference to hash table being iterated
+    size_t _index; // current index into ht._entries
+} hti;
+
+
+//Return new hash table iterator (for use with ht_next)
+hti ht_iterator(ht* table);
+
+/*
+Move iterator to next item in hash table, update iterator's key 
+and value to current item, and return true. If there are no more 
+items, return false. Don't call ht_set during iteration.
+*/
+bool ht_next(hti* it);
+
+
 #endif
\ No newline at end of file
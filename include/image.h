@@ -0,0 +1,73 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "stdint.h"
+
+// Number of zero words from which image_fill keeps them as a region instead of storing them
+#define IMAGE_FILL_MIN 16
+
+// Zero words reserved by .blkw that the image holds without storing them
+typedef struct {
+    size_t at;    // stored words before the region
+    size_t count; // zero words in the region
+} image_region;
+
+// Assembled program: origin followed by its words in address order, with runs of zeros
+// kept as regions between the stored words. Create with image_create, free with image_destroy
+typedef struct {
+    uint16_t orig;           // address of the first word
+    uint16_t* words;         // encoded words, without the zeros of the regions
+    size_t length;           // number of stored words
+    size_t capacity;         // size of words array
+    image_region* regions;   // zero regions in address order, several can be at the same place
+    size_t region_count;     // number of regions
+    size_t region_capacity;  // size of regions array
+    size_t zeros;            // zero words in all the regions
+} image;
+
+//create empty image and return pointer to it, or NULL if out of memory.
+image* image_create(void);
+
+//Free memory allocated for the image
+void image_destroy(image* img);
+
+//Remove every word, keeping the words and regions arrays for reuse
+static inline void image_clear(image* img){
+    img->orig = 0;
+    img->length = 0;
+    img->region_count = 0;
+    img->zeros = 0;
+}
+
+//Return the number of words in the program, stored ones and the zeros of the regions
+static inline size_t image_size(const image* img){
+    return img->length + img->zeros;
+}
+
+//Grow the words array so at least one more word fits, return false if out of memory.
+bool image_grow(image* img);
+
+//Make room for at least extra more words, return false if out of memory.
+bool image_reserve(image* img, size_t extra);
+
+//Append the words and regions of src to the end of dst, return false if out of memory.
+bool image_append(image* dst, const image* src);
+
+//Make room for at least extra more regions, return false if out of memory.
+bool image_reserve_regions(image* img, size_t extra);
+
+//Append count zero words, as a region if there are IMAGE_FILL_MIN or more. Return false if out of memory.
+bool image_fill(image* img, size_t count);
+
+//Append word to the end of the image, return false if out of memory.
+static inline bool image_push(image* img, uint16_t word){
+    if (img->length >= img->capacity && !image_grow(img)){
+        return false;
+    }
+    img->words[img->length++] = word;
+    return true;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef IR_H
+#define IR_H
+
+#include "fileFunctions.h"
+#include "symtab.h"
+#include "threadpool.h"
+
+/*
+Source lexed once into an array with an entry for every line that has anything on
+it, blank and comment lines are left out. Both passes of the assembler walk it
+instead of reading the text again, and it holds everything a listing or a loader
+needs to go through the program line by line. Sources up to 4 GB only.
+*/
+
+// Bytes of source each task lexes when ir_build is given a pool
+#ifndef IR_SEGMENT_BYTES
+#define IR_SEGMENT_BYTES (1 << 20)
+#endif
+
+	enum
+	{
+	   OPERAND_NONE,     // no operand
+	   OPERAND_REGISTER, // r0 to r7, value is the register number
+	   OPERAND_NUMBER,   // #decimal or xhex, value is the number
+	   OPERAND_LABEL,    // label reference, value is its symbol id
+	   OPERAND_TEXT      // anything else, such as the string of a .stringz
+	};
+
+#define IR_NO_LABEL -1
+
+// Flags of an ir_line
+#define IR_BAD_LABEL 1 // the label defined on the line isn't valid, so it has no id
+#define IR_LONG_LINE 2 // operands are too far into the line for their offsets, use ir_operands
+
+// An operand, its text is kept as a position in the line
+typedef struct {
+    uint16_t offset; // start of the text, from the start of the line
+    uint16_t length; // length of the text
+    int32_t value;   // register number, number or symbol id, depending on the kind
+} ir_operand;
+
+// A line of the source, 48 bytes
+typedef struct {
+    ir_operand args[4];
+    uint32_t pos;    // source offset of the line
+    uint32_t line;   // line number, counting from 1
+    int32_t label;   // symbol id of the label the line defines, IR_NO_LABEL if none
+    uint8_t opcode;  // opcode enum, NUM_OPCODES if there is no known opcode
+    uint8_t flags;   // IR_BAD_LABEL and IR_LONG_LINE
+    uint16_t kinds;  // kind of operand i in bits 4i to 4i+3
+} ir_line;
+
+// A slice of the source lexed on its own, see ir.c
+typedef struct ir_segment ir_segment;
+
+// The lines of a source: set up with ir_init, fill with ir_build, free with ir_free
+typedef struct {
+    ir_line* lines;
+    size_t length;   // number of lines
+    size_t capacity; // size of lines array
+    const char* data; // source the lines point into
+    size_t size;      // bytes of source
+    int total;        // lines in the source, blank ones included
+    size_t orig;      // index of the first .orig line, length if there is none
+    ir_segment* segments;    // slices lexed in parallel, kept for the next build
+    size_t segment_capacity; // size of segments array
+} asm_ir;
+
+void ir_init(asm_ir* ir);
+
+void ir_free(asm_ir* ir);
+
+/*
+Lex every line of input into ir, replacing what it held. Labels defined and
+referenced are interned into table, the symbol ids are what the lines store.
+Given a pool, slices of IR_SEGMENT_BYTES are lexed in parallel and joined, with
+the labels interned by every slice at once. Symbol ids then depend on timing, the
+lines are the same either way. The source must outlive the ir. Return false if
+out of memory or the source is bigger than 4 GB.
+*/
+bool ir_build(asm_ir* ir, source* input, symtab* table, threadpool* pool);
+
+//Return the kind of operand i of the line
+static inline int ir_kind(const ir_line* line, int i){
+    return (line->kinds >> (4 * i)) & 0xF;
+}
+
+//Return the index of the operand of opcode that names a label, -1 if it takes none
+int ir_label_operand(int opcode);
+
+//Set args to the text of the four operands of line index, empty tokens for missing ones
+void ir_operands(const asm_ir* ir, size_t index, token args[4]);
+
+//Lex line index again for the text of its label and opcode as well as its operands
+void ir_relex(const asm_ir* ir, size_t index, token* label, token* opcode, token args[4]);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef ISA_H
+#define ISA_H
+
+#include "fileFunctions.h"
+
+/*
+The instruction set as tables, generated from isa/ahasm.isa by isagen when the
+library is built. Every instruction form is a base word plus fields, each a few
+bits of one operand shifted into place, so the assembler encodes any instruction
+with one loop over its fields and the disassembler decodes with the same tables.
+*/
+
+#define ISA_MAX_FIELDS 6
+
+	enum
+	{
+	   ISA_REGISTER,     // r0 to r7
+	   ISA_RAW_REGISTER, // register whose digit goes into its field without being checked
+	   ISA_NUMBER,       // number, truncated to its type and then range checked
+	   ISA_LABEL         // label, PC-relative: the words from the instruction to it, truncated and checked like a number
+	};
+
+// An operand of an instruction form
+typedef struct {
+    uint8_t kind;    // ISA_REGISTER, ISA_RAW_REGISTER, ISA_NUMBER or ISA_LABEL
+    uint8_t bits;    // numbers and labels are truncated to 8 or 16 bits before the range check
+    bool is_signed;  // and sign extended from there if set
+    int16_t min;     // smallest value accepted
+    int16_t max;     // largest value accepted
+} isa_operand;
+
+// Bits of an operand placed in the word
+typedef struct {
+    uint8_t operand; // operand the bits come from
+    uint8_t shift;   // lowest operand bit taken
+    uint8_t width;   // number of bits taken
+    uint8_t pos;     // lowest bit of the word they go to
+    uint8_t bias;    // added to the bits before they're cut to width
+} isa_field;
+
+// An instruction form, one line of the description
+typedef struct {
+    uint16_t base;          // word with every field zero
+    uint16_t mask;          // bits of the word no field covers
+    uint8_t opcode;         // opcode enum
+    uint8_t operand_count;  // number of operands
+    int8_t select;          // operand that picks the next form instead when it starts with 'r', -1 if none
+    uint8_t field_count;    // number of fields
+    isa_operand operands[4];
+    isa_field fields[ISA_MAX_FIELDS];
+} isa_form;
+
+extern const isa_form isa_forms[];
+
+extern const size_t isa_form_count;
+
+// Index in isa_forms of the first form of every opcode plus one, 0 for pseudo ops
+extern const uint8_t isa_opcode_forms[NUM_OPCODES];
+
+// Index of every form, those with the most fixed bits first, the order a word is matched in
+extern const uint8_t isa_decode_order[];
+
+//Return the first form of opcode, NULL for pseudo ops and anything out of range
+static inline const isa_form* isa_form_of(int opcode){
+    unsigned index = (unsigned)opcode < NUM_OPCODES ? isa_opcode_forms[opcode] : 0;
+    return index > 0 ? &isa_forms[index - 1] : NULL;
+}
+
+//Truncate value to the bits of the operand, sign extending if it is signed
+static inline int32_t isa_truncate(const isa_operand* operand, int32_t value){
+    int shift = 32 - operand->bits;
+    uint32_t bits = (uint32_t)value << shift;
+    return operand->is_signed ? (int32_t)bits >> shift : (int32_t)(bits >> shift);
+}
+
+//Find the form word was encoded with and set values to its operands, return NULL if it matches none
+const isa_form* isa_decode(uint16_t word, int32_t values[4]);
+
+/*
+Write word as assembly into text of the given size the way snprintf does and
+return the length it needed. PC-relative operands are written as the address
+they point to, counted from the word after the one at address. Words that match
+no form come out as a .fill.
+*/
+int isa_disassemble(uint16_t word, int address, char* text, size_t size);
+
+#endif
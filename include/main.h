@@ -1,10 +1,16 @@
-
-#ifndef MAIN_H
-#define MAIN_H
-#define true 1
-#define false 0
-#include "fileFunctions.h"
-#include "assembler.h"
-
-
-#endif
\ No newline at end of file
+
+#ifndef MAIN_H
+#define MAIN_H
+#define true 1
+#define false 0
+#include "fileFunctions.h"
+#include "assembler.h"
+#include "batch.h"
+#include "server.h"
+
+void obtainFilePath(char* inputFile, char* outputFile, uint16_t maxsize);
+
+void assemble(const char* inputFile,const char* outputFile, const asm_options* options);
+
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include "image.h"
+
+	enum
+	{
+	   FORMAT_HEX, // text listing, origin then one "0xNNNN" line per word
+	   FORMAT_BIN, // raw big-endian words
+	   FORMAT_OBJ, // LC-3 style object, big-endian origin followed by the words
+	   FORMAT_SOBJ // sparse object, big-endian origin followed by records: a header word
+	               // below 0x8000 is followed by that many words, 0x8000 | N stands for N zero words
+	};
+
+//Return the output format named by the given string (hex, bin, obj or sobj), or -1 if unknown
+int findFormat(const char* name);
+
+//Return the file extension for the format, ".hex", ".bin", ".obj" or ".sobj"
+const char* formatExtension(int format);
+
+//Return true if the format is written as bytes rather than text
+bool isBinaryFormat(int format);
+
+/*
+Write img to output in the given format. The image is formatted into a large
+buffer that is written with one fwrite each time it fills up, hex lines eight
+words at a time with SSSE3 where the CPU has it. Zero regions are a single
+record in a sparse object, copies of a zero line or a memset in the others. Return false if out of memory or a write failed.
+*/
+bool writeImage(image* img, FILE* output, int format);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+Line scanner: classifies a block of up to 64 bytes of source at once, so the
+lexer finds where the code of a line stops and where its tokens are with bit
+operations instead of looking at every byte. The kernel is picked at runtime,
+AVX2 or SSE2 on x86 CPUs that have them, plain C everywhere else.
+*/
+
+#define SCAN_BLOCK 64
+
+	enum
+	{
+	   SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2, NUM_SCANNERS
+	};
+
+// Bit i is set for byte i of the block
+typedef struct {
+    uint64_t delimiters; // space, tab, comma, carriage return or newline, what separates tokens
+    uint64_t stops;      // newline or ';', the code of the line ends at the first. Bytes past the end are stops too
+} scan_mask;
+
+//Classify the first SCAN_BLOCK bytes of text, or all of them if size is less.
+//Bits past the first stop may be left clear, only the line up to there counts
+scan_mask scan_block(const char* text, size_t size);
+
+//Return the kernel scan_block runs, the fastest the CPU supports unless scan_use picked another
+int scan_kernel(void);
+
+//Make scan_block run kernel, for benchmarks and testing. Return false if the CPU can't run it
+bool scan_use(int kernel);
+
+//Return the name of kernel, "scalar", "sse2" or "avx2"
+const char* scan_kernel_name(int kernel);
+
+//Return the kernel with the given name, -1 if there is none
+int scan_find_kernel(const char* name);
+
+//Return the index of the lowest set bit of bits, which must not be 0
+static inline unsigned scan_first(uint64_t bits){
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctzll(bits);
+#else
+    unsigned index = 0;
+    while ((bits & 1) == 0){
+        bits >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef SERVER_H
+#define SERVER_H
+#include "assembler.h"
+
+/*
+Assembler daemon listening on a local Unix socket. Clients send source bytes and get
+back the image and the diagnostics, so small programs skip process startup and every
+request reuses warm label tables, arenas and threads. Requests and replies are in host
+byte order, client and server run on the same machine.
+*/
+
+#define SERVER_PATH_LENGTH 108
+
+	enum
+	{
+	   REQUEST_ASSEMBLE, // source follows the request, answered with a reply
+	   REQUEST_STOP      // finish the requests in flight and exit, no reply
+	};
+
+//Write the default socket path into path, in $XDG_RUNTIME_DIR or else /tmp with the user id in its name
+void defaultSocketPath(char* path, size_t size);
+
+/*
+Serve assemble requests on the socket at path until a client sends REQUEST_STOP.
+Connections are served in parallel on options->threads threads (0 for every core),
+each with its own workspace kept from one request to the next. The pass mode is
+taken from each request, the rest of options applies to all of them. Return the
+exit status.
+*/
+int runServer(const char* path, const asm_options* options);
+
+//Connect to the server at path, return the socket or -1 if there is no server
+int connectServer(const char* path);
+
+/*
+Have the server connected on fd assemble size bytes of source text with the given
+pass mode. The words and origin are added to output and the errors to diags just
+as assembleBuffer would. Return false on errors, a lost connection is reported
+as one. Several requests can be sent one after another on the same connection.
+*/
+bool remoteAssemble(int fd, const char* text, size_t size, int passMode, image* output, diag_list* diags);
+
+//Ask the server connected on fd to stop, return false if it couldn't be told
+bool stopServer(int fd);
+
+//Close a connection made with connectServer
+void disconnectServer(int fd);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "symtab.h"
+
+	enum
+	{
+	   PHASE_LEX, PHASE_FIND_ORIG, PHASE_FIRST_PASS, PHASE_SECOND_PASS, PHASE_OUTPUT, NUM_PHASES
+	};
+
+/*
+Where the time of an assembly went. Pass one in asm_options to have it filled in,
+timing is skipped entirely when there is none. Values add up over every assembly
+the stats are passed to. The output phase is filled in by whoever writes the image.
+*/
+typedef struct {
+    double seconds[NUM_PHASES]; // wall time spent in each phase
+    size_t lines[NUM_PHASES];   // source lines each phase read, output lines written
+    size_t bytes[NUM_PHASES];   // source bytes each phase read, output bytes written
+    size_t assemblies;          // number of assemblies added up
+    size_t cacheHits;           // assemblies whose image came from the cache
+    ht_stats labels;            // label table, counts add up, capacity and max probe are the largest seen
+    size_t allocations;         // heap allocations made by the library while assembling
+} asm_stats;
+
+//Return the name of the phase, "lex", "findOrig", "firstPass", "secondPass" or "output"
+const char* phaseName(int phase);
+
+//Return a monotonic wall clock time in seconds
+double stats_now(void);
+
+//Add the stats of src to dst
+void stats_add(asm_stats* dst, const asm_stats* src);
+
+/*
+Count heap allocations made by the library into the counter of the calling
+thread, and not at all if it has none. Only called on paths that allocate, so
+the cost is lost in the allocation itself.
+*/
+void stats_count_alloc(size_t count);
+
+//Make counter the one allocations on the calling thread are counted into, NULL to stop counting. Return the one it replaces
+size_t* stats_count_into(size_t* counter);
+
+//Return the counter allocations on the calling thread are counted into, NULL if they aren't
+size_t* stats_counter(void);
+
+//Return the peak resident set size of the process in bytes, 0 if it isn't known
+size_t stats_peak_rss(void);
+
+//Print the stats to output as a text report, or as a single JSON object if json is true
+void stats_print(const asm_stats* stats, FILE* output, bool json);
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "stdlib.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "arena.h"
+#include "ht.h"
+
+/*
+Symbol table mapping labels to their 16 bit address: create with symtab_create,
+free with symtab_destroy. Like ht, keys are ASCII case-insensitive. The slots hold
+the hash and length of the key, so a probe only reads key memory when those already
+match. Every symbol also gets an id, counting up from 0 as symbols are added, and
+addresses are kept in an array indexed by it, so code that interned its labels up
+front looks addresses up without hashing.
+*/
+typedef struct symtab symtab;
+
+	enum
+	{
+	   SYM_ADDED, SYM_EXISTS, SYM_NO_MEMORY
+	};
+
+//create symbol table with keys copied into the given arena, which must outlive
+//the table. Return NULL if out of memory.
+symtab* symtab_create(arena* keys);
+
+//Free memory allocated for the symbol table, keys go away with the arena
+void symtab_destroy(symtab* table);
+
+//Remove every symbol but keep the slots allocated. Keys already copied stay in the arena.
+void symtab_clear(symtab* table);
+
+//Look up key of the given length, return false if it isn't in the table or has no address yet.
+//Safe to call while other threads are in symtab_intern_shared, it never waits for them.
+bool symtab_get(symtab* table, const char* key, size_t length, uint16_t* address);
+
+/*
+Add key of the given length with its address. Return SYM_ADDED, SYM_EXISTS if
+key already has an address (which is left alone) or SYM_NO_MEMORY.
+*/
+int symtab_add(symtab* table, const char* key, size_t length, uint16_t address);
+
+/*
+Return the id of key, adding it without an address if it isn't in the table yet.
+Return -1 if out of memory.
+*/
+int32_t symtab_intern(symtab* table, const char* key, size_t length);
+
+/*
+Get the table ready for symtab_intern_shared with room for expected more symbols.
+Return false if out of memory.
+*/
+bool symtab_share(symtab* table, size_t expected);
+
+/*
+Same as symtab_intern but several threads can call it at once, taking slots with
+compare and swap. The table doesn't expand meanwhile, so -1 is returned once the
+room made by symtab_share is used up. Keys aren't copied, they must stay around
+until symtab_freeze, and ids depend on which thread gets to a symbol first.
+*/
+int32_t symtab_intern_shared(symtab* table, const char* key, size_t length);
+
+/*
+Finish interning with symtab_intern_shared, once no thread is calling it any more.
+The keys are copied into the arena as lowercase, after which the table no longer
+needs them and is an ordinary one again. Return false if out of memory.
+*/
+bool symtab_freeze(symtab* table);
+
+/*
+Give symbol id its address. Return SYM_ADDED, or SYM_EXISTS if it already has one,
+which is left alone. Several threads can define symbols at once as long as nothing
+is added to the table meanwhile, of two defining the same symbol only one gets SYM_ADDED.
+*/
+int symtab_define(symtab* table, int32_t id, uint16_t address);
+
+//Take the address off every symbol, they keep their ids
+void symtab_undefine(symtab* table);
+
+//Look up the address of symbol id, return false if it has none yet.
+bool symtab_address(symtab* table, int32_t id, uint16_t* address);
+
+//return number of symbols in table
+size_t symtab_length(symtab* table);
+
+/*
+Make room for expected symbols in total, so adding them doesn't expand the table
+one doubling at a time. Return false if out of memory.
+*/
+bool symtab_reserve(symtab* table, size_t expected);
+
+//Set the fraction of slots used before the table doubles, as ht_set_max_load
+void symtab_set_max_load(symtab* table, double load);
+
+/*
+Fill in stats for the table, expansions count the times it filled up and doubled
+since it was created, sizing it with symtab_reserve isn't one. Probe lengths are
+worked out from where each symbol sits relative to its home slot, so lookups
+themselves don't pay for counting.
+*/
+void symtab_info(symtab* table, ht_stats* stats);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+
+// Pool of worker threads: create with pool_create, free with pool_destroy
+typedef struct threadpool threadpool;
+
+/*
+A task run by the pool, index is in [0, count) of the pool_run call and thread
+in [0, pool_size) tells which thread it runs on, so tasks can keep per-thread state.
+*/
+typedef void (*pool_task)(void* arg, size_t index, int thread);
+
+//Return the number of online processors, at least 1
+int cpu_count(void);
+
+/*
+Create a pool that runs tasks on the given number of threads, counting the 
+caller of pool_run as one of them. Returns NULL if out of memory or threads
+couldn't be started.
+*/
+threadpool* pool_create(int threads);
+
+//Stop the worker threads and free the pool
+void pool_destroy(threadpool* pool);
+
+//Return the number of threads tasks run on, including the caller
+int pool_size(threadpool* pool);
+
+/*
+Run task(arg, i, thread) for every i in [0, count) and return once all of them are done.
+Indices are handed out in increasing order. A NULL pool runs the tasks on the 
+calling thread, which is thread 0. Only one thread may call pool_run on a pool at a time.
+*/
+void pool_run(threadpool* pool, pool_task task, void* arg, size_t count);
+
+#endif
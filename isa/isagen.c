@@ -0,0 +1,303 @@
+/*
+Instruction table generator, run by the build to turn the instruction set description
+into the tables the assembler and disassembler share:
+
+  isagen ahasm.isa isa_table.c
+
+See ahasm.isa for the format. Nothing is written if the description has an error,
+which is printed as file:line: message.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_FORMS 255
+#define MAX_OPERANDS 4
+#define MAX_FIELDS 6  // ISA_MAX_FIELDS in isa.h
+#define MAX_NAME 16
+
+typedef struct {
+    const char* kind; // enum name of the kind
+    int bits;
+    bool is_signed;
+    int min;
+    int max;
+} gen_operand;
+
+typedef struct {
+    int operand;
+    int shift;
+    int width;
+    int pos;
+    int bias;
+} gen_field;
+
+typedef struct {
+    char opcode[MAX_NAME];
+    unsigned base;
+    unsigned mask;
+    int operand_count;
+    int select;
+    int field_count;
+    gen_operand operands[MAX_OPERANDS];
+    gen_field fields[MAX_FIELDS];
+} gen_form;
+
+static gen_form forms[MAX_FORMS];
+static int formCount;
+static const char* inputPath;
+static int lineNumber;
+
+static bool fail(const char* message, const char* text){
+    fprintf(stderr, "%s:%d: %s%s\n", inputPath, lineNumber, message, text);
+    return false;
+}
+
+// Parse TYPE:MIN:MAX, e.g. "s8:-8:7"
+static bool parseNumber(const char* text, gen_operand* operand){
+    char type[4];
+    int length = 0;
+    if (sscanf(text, "%3[us0-9]:%d:%d%n", type, &operand->min, &operand->max, &length) != 3 || text[length] != '\0'){
+        return fail("bad number operand ", text);
+    }
+    operand->is_signed = type[0] == 's';
+    operand->bits = atoi(type + 1);
+    if ((type[0] != 'u' && type[0] != 's') || (operand->bits != 8 && operand->bits != 16)){
+        return fail("number type must be u8, s8, u16 or s16, not ", type);
+    }
+    if (operand->min > operand->max || operand->min < INT16_MIN || operand->max > INT16_MAX){
+        return fail("bad range in ", text);
+    }
+    return true;
+}
+
+static bool parseOperand(const char* text, gen_operand* operand){
+    memset(operand, 0, sizeof(*operand));
+    if (strcmp(text, "R") == 0){
+        operand->kind = "ISA_REGISTER";
+        return true;
+    }
+    if (strcmp(text, "r") == 0){
+        operand->kind = "ISA_RAW_REGISTER";
+        return true;
+    }
+    if (strncmp(text, "label:", 6) == 0){
+        operand->kind = "ISA_LABEL";
+        return parseNumber(text + 6, operand);
+    }
+    operand->kind = "ISA_NUMBER";
+    return parseNumber(text, operand);
+}
+
+// Parse N[>>SHIFT][+BIAS]@POS:WIDTH
+static bool parseField(const char* text, gen_form* form){
+    if (form->field_count == MAX_FIELDS){
+        return fail("too many fields at ", text);
+    }
+    gen_field* field = &form->fields[form->field_count++];
+    memset(field, 0, sizeof(*field));
+    const char* p = text;
+    char* end;
+    field->operand = (int)strtol(p, &end, 10);
+    if (end == p){
+        return fail("bad field ", text);
+    }
+    p = end;
+    if (strncmp(p, ">>", 2) == 0){
+        field->shift = (int)strtol(p + 2, &end, 10);
+        p = end;
+    }
+    if (*p == '+'){
+        field->bias = (int)strtol(p + 1, &end, 10);
+        p = end;
+    }
+    int length = 0;
+    if (sscanf(p, "@%d:%d%n", &field->pos, &field->width, &length) != 2 || p[length] != '\0'){
+        return fail("bad field ", text);
+    }
+    if (field->operand < 0 || field->operand >= form->operand_count){
+        return fail("field of a missing operand ", text);
+    }
+    if (field->width < 1 || field->pos < 0 || field->pos + field->width > 16 || field->shift < 0 || field->shift > 15
+        || field->bias < 0 || field->bias >= (1 << field->width)){
+        return fail("field out of the word ", text);
+    }
+    form->mask &= ~(((1u << field->width) - 1) << field->pos) & 0xFFFF;
+    return true;
+}
+
+static bool isRegister(const gen_operand* operand){
+    return strcmp(operand->kind, "ISA_REGISTER") == 0 || strcmp(operand->kind, "ISA_RAW_REGISTER") == 0;
+}
+
+// A second form of the same opcode takes a register where the first takes a number
+static bool pairForms(gen_form* first, const gen_form* second){
+    if (first->select >= 0){
+        return fail("more than two forms of ", first->opcode);
+    }
+    if (first->operand_count == second->operand_count){
+        for (int i = 0; i < first->operand_count; ++i){
+            if (!isRegister(&first->operands[i]) && isRegister(&second->operands[i])){
+                first->select = i;
+                return true;
+            }
+        }
+    }
+    return fail("second form must take a register where the first takes a number: ", first->opcode);
+}
+
+static bool parseLine(char* text){
+    char* comment = strchr(text, ';');
+    if (comment != NULL){
+        *comment = '\0';
+    }
+    char* opcode = strtok(text, " \t\r\n");
+    if (opcode == NULL){
+        return true;
+    }
+    if (formCount == MAX_FORMS){
+        return fail("too many forms", "");
+    }
+    gen_form* form = &forms[formCount];
+    memset(form, 0, sizeof(*form));
+    form->select = -1;
+    form->mask = 0xFFFF;
+    if (strlen(opcode) >= MAX_NAME){
+        return fail("opcode name too long: ", opcode);
+    }
+    strcpy(form->opcode, opcode);
+
+    char* base = strtok(NULL, " \t\r\n");
+    char* end;
+    form->base = base != NULL ? (unsigned)strtoul(base, &end, 0) : 0;
+    if (base == NULL || *end != '\0' || form->base > 0xFFFF){
+        return fail("bad base word for ", opcode);
+    }
+    char* operands = strtok(NULL, " \t\r\n");
+    if (operands == NULL){
+        return fail("no operands for ", opcode);
+    }
+    char* fields = strtok(NULL, "\r\n");
+
+    if (strcmp(operands, "-") != 0){
+        char* save;
+        for (char* operand = strtok_r(operands, ",", &save); operand != NULL; operand = strtok_r(NULL, ",", &save)){
+            if (form->operand_count == MAX_OPERANDS){
+                return fail("too many operands for ", opcode);
+            }
+            if (!parseOperand(operand, &form->operands[form->operand_count++])){
+                return false;
+            }
+        }
+    }
+    if (fields != NULL){
+        char* save;
+        for (char* field = strtok_r(fields, " \t", &save); field != NULL; field = strtok_r(NULL, " \t", &save)){
+            if (!parseField(field, form)){
+                return false;
+            }
+        }
+    }
+    if (formCount > 0 && strcmp(forms[formCount - 1].opcode, opcode) == 0 && !pairForms(&forms[formCount - 1], form)){
+        return false;
+    }
+    for (int i = 0; i < formCount; ++i){
+        if (strcmp(forms[i].opcode, opcode) == 0 && i < formCount - 1){
+            return fail("forms of an opcode must be next to each other: ", opcode);
+        }
+    }
+    formCount++;
+    return true;
+}
+
+static int fixedBits(const gen_form* form){
+    int count = 0;
+    for (unsigned mask = form->mask; mask != 0; mask &= mask - 1){
+        count++;
+    }
+    return count;
+}
+
+static void writeTable(FILE* out){
+    const char* name = strrchr(inputPath, '/') != NULL ? strrchr(inputPath, '/') + 1 : inputPath;
+    fprintf(out, "/* Generated by isagen from %s, edit that instead */\n", name);
+    fprintf(out, "#include \"isa.h\"\n\n");
+
+    fprintf(out, "const isa_form isa_forms[] = {\n");
+    for (int i = 0; i < formCount; ++i){
+        const gen_form* form = &forms[i];
+        fprintf(out, "    {0x%04X, 0x%04X, %s, %d, %d, %d, {", form->base, form->mask, form->opcode,
+            form->operand_count, form->select, form->field_count);
+        for (int k = 0; k < form->operand_count; ++k){
+            const gen_operand* operand = &form->operands[k];
+            fprintf(out, "%s{%s, %d, %s, %d, %d}", k > 0 ? ", " : "", operand->kind, operand->bits,
+                operand->is_signed ? "true" : "false", operand->min, operand->max);
+        }
+        fprintf(out, "}, {");
+        for (int k = 0; k < form->field_count; ++k){
+            const gen_field* field = &form->fields[k];
+            fprintf(out, "%s{%d, %d, %d, %d, %d}", k > 0 ? ", " : "", field->operand, field->shift, field->width,
+                field->pos, field->bias);
+        }
+        fprintf(out, "}},\n");
+    }
+    fprintf(out, "};\n\n");
+    fprintf(out, "const size_t isa_form_count = %d;\n\n", formCount);
+
+    fprintf(out, "const uint8_t isa_opcode_forms[NUM_OPCODES] = {\n");
+    for (int i = 0; i < formCount; ++i){
+        if (i == 0 || strcmp(forms[i - 1].opcode, forms[i].opcode) != 0){
+            fprintf(out, "    [%s] = %d,\n", forms[i].opcode, i + 1);
+        }
+    }
+    fprintf(out, "};\n\n");
+
+    // most fixed bits first so a form is tried before any it's a special case of
+    fprintf(out, "const uint8_t isa_decode_order[] = {\n   ");
+    for (int bits = 16; bits >= 0; --bits){
+        for (int i = 0; i < formCount; ++i){
+            if (fixedBits(&forms[i]) == bits){
+                fprintf(out, " %d,", i);
+            }
+        }
+    }
+    fprintf(out, "\n};\n");
+}
+
+int main(int argc, char** argv){
+    if (argc != 3){
+        fprintf(stderr, "Usage: isagen description output\n");
+        return 1;
+    }
+    inputPath = argv[1];
+    FILE* in = fopen(inputPath, "r");
+    if (in == NULL){
+        fprintf(stderr, "Cannot open %s\n", inputPath);
+        return 1;
+    }
+    char text[512];
+    bool ok = true;
+    while (ok && fgets(text, sizeof(text), in) != NULL){
+        lineNumber++;
+        ok = parseLine(text);
+    }
+    fclose(in);
+    if (!ok){
+        return 1;
+    }
+
+    FILE* out = fopen(argv[2], "w");
+    if (out == NULL){
+        fprintf(stderr, "Cannot create %s\n", argv[2]);
+        return 1;
+    }
+    writeTable(out);
+    if (fclose(out) != 0){
+        fprintf(stderr, "Could not write %s\n", argv[2]);
+        remove(argv[2]);
+        return 1;
+    }
+    return 0;
+}
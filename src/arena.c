@@ -0,0 +1,108 @@
+#include "arena.h"
+#include "stats.h"
+#include "string.h"
+#include "stddef.h"
+
+#define BLOCK_SIZE (64 * 1024)
+#define ALIGNMENT (sizeof(max_align_t))
+#define ALIGN_UP(n) (((n) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+// A block of arena memory, the allocations follow the header
+typedef struct block {
+    struct block* next; // previously filled block
+    size_t size;        // bytes available after the header
+    max_align_t data[];
+} block;
+
+struct arena {
+    block* head;  // block being allocated from
+    block* first; // block allocated by arena_create, kept by arena_reset
+    size_t used;  // bytes used in head
+};
+
+// Allocate a block with room for at least size bytes and push it on the arena
+static bool arena_grow(arena* a, size_t size){
+    size_t block_size = size > BLOCK_SIZE ? size : BLOCK_SIZE;
+    block* b = malloc(sizeof(block) + block_size);
+    if (b == NULL){
+        return false;
+    }
+    stats_count_alloc(1);
+    b->next = a->head;
+    b->size = block_size;
+    a->head = b;
+    a->used = 0;
+    return true;
+}
+
+arena* arena_create(void){
+    arena* a = malloc(sizeof(arena));
+    if (a == NULL){
+        return NULL;
+    }
+    stats_count_alloc(1);
+    a->head = NULL;
+    a->used = 0;
+    if (!arena_grow(a, BLOCK_SIZE)){
+        free(a);
+        return NULL;
+    }
+    a->first = a->head;
+    return a;
+}
+
+void arena_destroy(arena* a){
+    if (a == NULL){
+        return;
+    }
+    arena_reset(a);
+    free(a->first);
+    free(a);
+}
+
+void* arena_alloc(arena* a, size_t size){
+    size = ALIGN_UP(size);
+    if (size > a->head->size - a->used){
+        // big allocations get a block of their own behind the current one,
+        // so the space left in it isn't wasted
+        if (size > BLOCK_SIZE / 4){
+            block* b = malloc(sizeof(block) + size);
+            if (b == NULL){
+                return NULL;
+            }
+            stats_count_alloc(1);
+            b->size = size;
+            b->next = a->head->next;
+            a->head->next = b;
+            return b->data;
+        }
+        if (!arena_grow(a, size)){
+            return NULL;
+        }
+    }
+    void* ptr = (char*)a->head->data + a->used;
+    a->used += size;
+    return ptr;
+}
+
+void* arena_calloc(arena* a, size_t size){
+    void* ptr = arena_alloc(a, size);
+    if (ptr != NULL){
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void arena_reset(arena* a){
+    block* b = a->head;
+    while (b != NULL){
+        block* next = b->next;
+        if (b != a->first){
+            free(b);
+        }
+        b = next;
+    }
+    a->first->next = NULL;
+    a->head = a->first;
+    a->used = 0;
+}
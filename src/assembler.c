@@ -1,1221 +1,1361 @@
-#include "assembler.h"
-
-#define MAX(x, y) ((x) > (y) ? (x) : (y))
-
-void firstPass(ht* table, FILE** input);
-void secondPass(ht* table, FILE** input, FILE** output);
-int findOrig(FILE** input, char* origStart);
-char* selectOpFunc(char* opCode, char* pArg1, char* pArg2, char* pArg3, char* pArg4,
-FILE** output, ht* table, int* offset, int location);
-char* add(char* pArg1, char* pArg2, char* pArg3);
-char* and(char* pArg1, char* pArg2, char* pArg3);
-char* or(char* pArg1, char* pArg2, char* pArg3);
-char* xor(char* pArg1, char* pArg2, char* pArg3);
-char* ldb(char* pArg1, char* pArg2, char* pArg3);
-char* ldw(char* pArg1, char* pArg2, char* pArg3);
-char* ldi(char* pArg1, char* pArg2, ht* table, int location);
-char* ldib(char* pArg1, char* pArg2, ht* table, int location);
-char* lea(char* pArg1, char* pArg2, ht* table, int location);
-char* stb(char* pArg1, char* pArg2, char* pArg3);
-char* stw(char* pArg1, char* pArg2, char* pArg3);
-char* sti(char* pArg1, char* pArg2,ht* table, int location);
-char* stib(char* pArg1, char* pArg2,ht* table, int location);
-char* br(uint8_t brID, char* pArg1, ht* table, int location);
-char* jmp(char* pArg1);
-char* jsr(char* pArg1, ht* table, int location);
-char* jsrr(char* pArg1);
-char* ret();
-char* rti();
-char* mul(char* pArg1, char* pArg2, char* pArg3);
-char* divide(char* pArg1, char* pArg2, char* pArg3);
-char* trap(char* pArg1);
-char* lshf(char* pArg1, char* pArg2, char* pArg3);
-char* rshfl(char* pArg1, char* pArg2, char* pArg3);
-char* rshfa(char* pArg1, char* pArg2, char* pArg3);
-char* mov(char* pArg1, char* pArg2);
-char* rot(char* pArg1, char* pArg2, char* pArg3);
-char* push(char* pArg1);
-char* pushb(char* pArg1);
-char* pop(char* pArg1);
-char* popb(char* pArg1);
-char* macc(char* pArg1, char* pArg2, char* pArg3, char* pArg4);
-char* extdb(char* pArg1, char* pArg2, char* pArg3);
-char* extdw(char* pArg1, char* pArg2, char* pArg3);
-char* blkw(char* pArg1, FILE** output, int* pOffset);
-char* fill(char* pArg1);
-char* stringz(char* pArg1, FILE** output, int* pOffset);
-
-ht* label_table = NULL;
-
-//Inner function for checking the given files are valid
-void checkFiles(const char* inputFile, const char* outputFile, FILE** input, FILE** output){
-    if (*input == NULL){
-        // try without the true source
-        char tempStr[255];
-        tempStr[0] = '\0';
-        strcat(tempStr, "asmFiles/");
-        strcat(tempStr,inputFile);
-        *input = fopen(tempStr, "r");
-        if (*input == NULL){
-            printf("Cannot find file name %s, terminating...", inputFile);
-            exit(4);
-        }
-    }
-
-    if (*output == NULL){
-        // try without the true source
-        char tempStr[255];
-        tempStr[0] = '\0';
-        strcat(tempStr, "asmFiles/");
-        strcat(tempStr, outputFile);
-        *output = fopen(tempStr, "r+");
-        if (*output == NULL){
-            printf("Cannot find file name %s, terminating...", outputFile);
-            exit(4);
-        }
-    }
-}
-
-
-/*
-Checks is a given label is valid.
-*/
-void checkLabel(char* label_str){
-    if (strlen(label_str) > 20){
-        printf("Invalid label %s, terminating...", label_str);
-        ht_destroy(label_table);
-        exit(4);
-    }
-    if (label_str[0] == 'x' || isdigit(label_str[0])){
-        printf("Invalid label %s, terminating...", label_str);
-        ht_destroy(label_table);
-        exit(4);
-    }
-    if (strcmp(label_str, "in") == 0 || strcmp(label_str, "out") == 0){
-        printf("Invalid label %s, terminating...", label_str);
-        ht_destroy(label_table);
-        exit(4);
-    }
-    if (strcmp(label_str, "getc") == 0 || strcmp(label_str, "puts") == 0){
-        printf("Invalid label %s, terminating...", label_str);
-        ht_destroy(label_table);
-        exit(4);
-    }
-
-    for (int i = 0; i < strlen(label_str); ++i){
-        if (isalnum(label_str[i]) == 0){
-        printf("Invalid label %s, terminating...", label_str);
-        ht_destroy(label_table);
-        exit(4);
-        }
-    }
-}
-
-int add_label_increment(char* pOpcode, char* pArg1){
-    int opcode = findOpcode(pOpcode);
-    if (opcode == BLKW){
-        int blkwrd_cnt = toNum(pArg1);
-        return blkwrd_cnt * 2;
-    } else if (opcode == STRINGZ){
-        size_t str_len = strlen(pArg1);
-        return (str_len + 1) & 0xFFFE;
-    } else {
-        return 2;
-    }
-}
-
-/*
-The main function of this file, this handles the actually assembly process
-*/
-void assemble(const char* inputFile,const char* outputFile){
-    FILE *input = fopen(inputFile, "r");
-    FILE *output = fopen(outputFile, "r+");
-
-    checkFiles(inputFile, outputFile, &input, &output);
-
-    label_table = ht_create();
-    firstPass(label_table, &input);
-    secondPass(label_table, &input, &output);
-    ht_destroy(label_table);
-    fclose(input);
-    fclose(output);
-}
-
-/*
-The first pass of the assembly process. This pass is used for collecting the labels into
-a hash table and associating the labels with their address in memory. These will be used
-in the second pass of the assembly process
-*/
-void firstPass(ht* table, FILE** input){
-
-    int lret, offset = 0;
-    char lLine[MAX_LINE_LENGTH+1];
-    char *pLabel, *pOpcode, *pArg1, *pArg2, *pArg3, *pArg4;
-
-    int orig = findOrig(input, NULL);
-    do {
-        lret = readAndParse(*input,lLine, &pLabel, &pOpcode, &pArg1, &pArg2, &pArg3, &pArg4);
-        if (lret != DONE && lret != EMPTY_LINE){
-            if (pLabel != NULL && pLabel[0] != '\0'){
-                checkLabel(pLabel);
-                if (ht_get(table,pLabel) == NULL){
-                    int* value = (int*)malloc(sizeof(int) * 1);
-                    *value = orig + offset;
-                    ht_set(table,pLabel, value);
-                } else {
-                    printf("Multiple label instances (%s), terminating...", pLabel);
-                    ht_destroy(label_table);
-                    exit(4);
-                }
-            }
-            offset += add_label_increment(pOpcode, pArg1);
-        }
-    } while(lret != DONE);
-    rewind(*input);
-}
-
-/*
-This function is used for finding the .orig opcode in the given file as this marks the start of 
-the assembly process. If there is no .orig found then the program should terminate at that point
-*/
-int findOrig(FILE** input, char* origStart){
-    int lret, itr = 0;
-    char lLine[MAX_LINE_LENGTH + 1];
-    char *pLabel, *pOpcode, *pArg1, *pArg2, *pArg3, *pArg4;
-
-    do {
-        lret = readAndParse(*input,lLine, &pLabel, &pOpcode, &pArg1, &pArg2, &pArg3, &pArg4);
-        if (lret != DONE && lret != EMPTY_LINE){
-            if (strcmp(pOpcode,".orig") == 0){
-                if (origStart != NULL){
-                    (void*)strcpy(origStart,pArg1);
-                }
-
-                return toNum(pArg1);
-            }
-        }
-
-    } while(lret != DONE);
-
-    printf("Did not find start of program, terminating...");
-    ht_destroy(label_table);
-    exit(4);
-return -1;
-}
-
-/*
-This handles the second pass of the assembly process. This is the
- pass where the majority of the work is done. Each line in the file corresponds to a
- single assembly instruction. First the specific opcode is determined and depending
- on the opcode we call a function corresponding to it that will return a string 
- that is the machine code string of that assembly instruction, this will be appended to
- the output file.
-*/
-void secondPass(ht* table, FILE** input, FILE** output){
-char origStr[6];
-int orig = findOrig(input,origStr);
-fprintf(*output,"%s\n",origStr);
-
-    int lret, offset = 0;
-    char lLine[MAX_LINE_LENGTH+1];
-    char *pLabel, *pOpcode, *pArg1, *pArg2, *pArg3, *pArg4;
-    do {
-        offset += 2;
-        lret = readAndParse(*input,lLine, &pLabel, &pOpcode, &pArg1, &pArg2, &pArg3, &pArg4);
-        if (lret != DONE && lret != EMPTY_LINE){
-            char* outString = selectOpFunc(pOpcode, pArg1, pArg2, pArg3, pArg4, output, table, &offset, orig+offset);
-            if (outString == NULL){
-                if (strcmp(pOpcode, ".end") == 0){
-                break;
-                }
-            } else {
-                fprintf(*output,"%s\n", outString);
-                free(outString);
-            }
-        }
-    } while(lret != DONE);
-}
-
-/*
-This file selects the specific opcode that we are working on and calls
-its corresponding function to get the complete asm instruction
-*/
-char* selectOpFunc(char* opCode, char* pArg1,char* pArg2, char* pArg3, char* pArg4,
-FILE** output, ht* table, int* offset, int location){
-
-    switch(findOpcode(opCode)){
-        case ADD: return add(pArg1, pArg2, pArg3);
-            break;
-        case AND: return and(pArg1, pArg2, pArg3);
-            break;
-        case OR: return or(pArg1, pArg2, pArg3);
-            break;
-        case XOR: return xor(pArg1, pArg2, pArg3);
-            break;
-        case LDB: return ldb(pArg1, pArg2, pArg3);
-            break;
-        case LDW: return ldw(pArg1, pArg2, pArg3);
-            break;
-        case LDI: return ldi(pArg1, pArg2, table,location);
-            break;
-        case LDIB: return ldib(pArg1, pArg2, table, location);
-            break;
-        case LEA: return lea(pArg1, pArg2, table, location);
-            break;
-        case STB: return stb(pArg1, pArg2, pArg3);
-            break;
-        case STW: return stw(pArg1, pArg2, pArg3);
-            break;
-        case STI: return sti(pArg1, pArg2, table, location);
-            break;
-        case STIB: return stib(pArg1, pArg2, table, location);
-            break;
-        case BR: return br(0, pArg1, table, location);
-            break;
-        case BRN: return br(4, pArg1, table, location);
-            break;
-        case BRNZ: return br(6, pArg1, table, location);
-            break;
-        case BRNP: return br(5, pArg1, table, location);
-            break;
-        case BRNZP: return br(7, pArg1, table, location);
-            break;
-        case BRZP: return br(3, pArg1, table, location);
-            break;
-        case BRZ: return br(2, pArg1, table, location);
-            break;
-        case BRP: return br(1, pArg1, table, location);
-            break;
-        case JMP: return jmp(pArg1);
-            break;
-        case JSR: return jsr(pArg1, table, location);
-            break;
-        case JSRR: return jsrr(pArg1);
-            break;
-        case RET: return ret();
-            break;
-        case RTI: return rti();
-            break;
-        case MUL: return mul(pArg1, pArg2, pArg3);
-            break;
-        case DIV: return divide(pArg1, pArg2, pArg3);
-            break;
-        case TRAP: return trap(pArg1);
-            break;
-        case LSHF: return lshf(pArg1, pArg2, pArg3);
-            break;
-        case RSHFL: return rshfl(pArg1, pArg2, pArg3);
-            break;
-        case RSHFA: return rshfa(pArg1, pArg2, pArg3);
-            break;
-        case MOV: return mov(pArg1, pArg2);
-            break;
-        case ROT: return rot(pArg1, pArg2, pArg3);
-            break;
-        case PUSH: return push(pArg1);
-            break;
-        case PUSHB: return pushb(pArg1);
-            break;
-        case POP: return pop(pArg1);
-            break;
-        case POPB: return popb(pArg1);
-            break;
-        case MACC: return macc(pArg1, pArg2, pArg3, pArg4);
-            break;
-        case EXTB: return extdb(pArg1, pArg2, pArg3);
-            break;
-        case EXTW: return extdw(pArg1, pArg2, pArg3);
-            break;
-        case HALT:char* tempStr = "x25";
-                    return trap(tempStr);
-            break;
-        case FILL: return fill(pArg1);
-            break;
-        case BLKW: return blkw(pArg1, output, offset);
-            break;
-        case STRINGZ: return stringz(pArg1, output, offset);
-            break;
-        case END: return NULL;
-            break;
-        case NUM_OPCODES: printf("invalid opcode %s, terminating,,,", opCode);
-                        ht_destroy(label_table);
-                        exit(2);
-            break;
-        default: printf("invalid opcode %s, terminating...", opCode);
-                ht_destroy(label_table);
-                exit(2);
-            break;
-    }
-}
-
-/*
-This function checks if a register argument is formatted properly. If not we terminate
-as this is an ill formed input file
-*/
-void checkRegValid(char* pArg){
-    if (pArg[0] != 'r'){
-        printf("Invalid Register Argument %s, must be in the format 'r1', terminating...", pArg);
-        ht_destroy(label_table);
-        exit(3);
-    }
-    if (!isdigit(pArg[1])){
-        printf("Invalid Register Argument %s, no digit in argument, terminating...", pArg);
-        ht_destroy(label_table);
-        exit(2);
-    }
-    if(pArg[1] - '0' > 7){
-        printf("Invalid Register Argumnet %s, digit must be less than 8, terminating...", pArg);
-        ht_destroy(label_table);
-        exit(4);
-    }
-}
-
-/*
- this function checks if a constant is within the correct range.
- Say that assembly instruction can have only an imm4 value but the
- number 100 is input, then this is invalid and the program will terminate
- */
-void checkConstantValid(int constantValue, int maxValue, int minValue){
-if (constantValue > maxValue){
-    printf("Constant value greater than accepted %d, terminating...", constantValue);
-    ht_destroy(label_table);
-    exit(4);
-}
-if (constantValue < minValue){
-    printf("Constant value less than accepted %d, terminating...", constantValue);
-    ht_destroy(label_table);
-    exit(4);
-}
-}
-
-/*
-The add function, this function handles the add opcode
-*/
-char* add(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x0000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-    
-    if (pArg3[0] == 'r'){ // reg version
-        uint8_t dig2 = (pArg1[1] - '0') + 8;
-        uint8_t dig3 = ((pArg2[1] - '0') << 1);
-        uint8_t dig4 = ((pArg3[1] - '0'));
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString(dig4);
-    } else { // imm version
-        uint8_t dig2 = (pArg1[1] - '0') + 8;
-        uint8_t dig3 = ((pArg2[1] - '0') << 1) + 1;
-        uint8_t dig4 = toNum(pArg3);
-        checkConstantValid(dig4, 7, -8);
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString((dig4) & 0xF);
-    }
-
-return strResult;
-}
-
-/*
-The and function, this function handles the and opcode
-*/
-char* and(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x2000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-
-    if (pArg3[0] == 'r'){
-        uint8_t dig2 = (pArg1[1] - '0') + 0x08;
-        uint8_t dig3 = ((pArg2[1] - '0') << 1);
-        uint8_t dig4 = ((pArg3[1] - '0'));
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString(dig4);
-    } else {
-        uint8_t dig2 = (pArg1[1] - '0') + 0x08;
-        uint8_t dig3 = ((pArg2[1] - '0') << 1) + 1;
-        uint8_t dig4 = toNum(pArg3);
-        checkConstantValid(dig4, 7, -8);
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString((dig4) & 0xF);
-    }
-return strResult;
-}
-
-/*
-The or function, this function handles the or opcode
-*/
-char* or(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x5000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-
-    if (pArg3[0] == 'r'){
-        uint8_t dig2 = (pArg1[1] - '0');
-        uint8_t dig3 = ((pArg2[1] - '0') << 1);
-        uint8_t dig4 = ((pArg3[1] - '0'));
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString(dig4);
-    } else {
-        uint8_t dig2 = (pArg1[1] - '0');
-        uint8_t dig3 = ((pArg2[1] - '0') << 1) + 1;
-        uint8_t dig4 = toNum(pArg3);
-        checkConstantValid(dig4, 7, -8);
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString((dig4) & 0xF);
-    }
-
-return strResult;
-}
-
-/*
-The xor function, this function handles the xor opcode
-*/
-char* xor(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x4000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-
-    if (pArg3[0] == 'r'){
-        uint8_t dig2 = (pArg1[1] - '0') + 8;
-        uint8_t dig3 = ((pArg2[1] - '0') << 1);
-        uint8_t dig4 = ((pArg3[1] - '0'));
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString(dig4);
-    } else {
-        uint8_t dig2 = (pArg1[1] - '0') + 8;
-        uint8_t dig3 = ((pArg2[1] - '0') << 1) + 1;
-        uint8_t dig4 = toNum(pArg3);
-        checkConstantValid(dig4, 7, -8);
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString((dig4) & 0xF);
-    }
-
-return strResult;
-}
-
-/*
-The ldb function, this function handles the ldb opcode
-*/
-char* ldb(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x1000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-
-    uint8_t dig4 = toNum(pArg3);
-    checkConstantValid(dig4, 31, -32);
-    uint8_t dig2 = (pArg1[1] - '0');
-    uint8_t dig3 = ((pArg2[1] - '0') << 1) + (((uint8_t)(dig4)) >> 4);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4 & 0x0F);
-
-    return strResult;
-}
-
-/*
-The ldw function, this function handles the ldw opcode
-*/
-char* ldw(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x3000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-
-    uint8_t dig4 = toNum(pArg3);
-    checkConstantValid(dig4, 31, -32);
-    uint8_t dig2 = (pArg1[1] - '0');
-    uint8_t dig3 = ((pArg2[1] - '0') << 1) + (((uint8_t)(dig4)) >> 4);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4 & 0x0F);
-
-return strResult;
-}
-
-/*
-The ldi function, this function handles the ldi opcode
-*/
-char* ldi(char* pArg1, char* pArg2, ht* table, int location){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x8000");
-
-    checkRegValid(pArg1);
-    uint8_t dig2 = pArg1[1] - '0';
-    int16_t* labelVal = ((int16_t*)ht_get(table, pArg2));
-    if (labelVal == NULL){
-        printf("Label %s not found, terminating...", pArg2);
-        ht_destroy(table);
-        exit(3);
-    }
-    
-    uint16_t offset = (*labelVal - (location)) / 2;
-    checkConstantValid(offset,127, -128);
-    uint8_t dig3 = (uint8_t)((offset >> 4) & 0xF);
-    uint8_t dig4 = (uint8_t)(offset & 0x0F);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4);
-
-return strResult;
-}
-
-/*
-The ldi function, this function handles the ldib opcode
-*/
-char* ldib(char* pArg1, char* pArg2, ht* table, int location){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0xD800");
-
-    checkRegValid(pArg1);
-    uint8_t dig2 = pArg1[1] - '0';
-    int16_t* labelVal = ((int16_t*)ht_get(table, pArg2));
-    if (labelVal == NULL){
-        printf("Label %s not found, terminating...", pArg2);
-        ht_destroy(table);
-        exit(3);
-    }
-    
-    uint16_t offset = (*labelVal - (location)) / 2;
-    checkConstantValid(offset,127, -128);
-    uint8_t dig3 = (uint8_t)((offset >> 4) & 0xF);
-    uint8_t dig4 = (uint8_t)(offset & 0x0F);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4);
-
-return strResult;
-}
-
-/*
-The lea function, this function handles the lea opcode
-*/
-char* lea(char* pArg1, char* pArg2, ht* table, int location){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x7000");
-    checkRegValid(pArg1);
-    uint8_t dig2 = pArg1[1] - '0';
-    int16_t* labelVal = ((int16_t*)ht_get(table, pArg2));
-    if (labelVal == NULL){
-        printf("Label %s not found, terminating...", pArg2);
-        ht_destroy(table);
-        exit(3);
-    }
-
-    int16_t offset = (*labelVal - (location)) / 2;
-    checkConstantValid(offset,127, -128);
-    uint8_t dig3 = (uint8_t)((offset >> 4) & 0xF);
-    uint8_t dig4 = (uint8_t)(offset & 0x0F);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4);
-
-return strResult;
-}
-
-/*
-The stb function, this function handles the stb opcode
-*/
-char* stb(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x1000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-
-    uint8_t dig4 = toNum(pArg3);
-    uint8_t dig2 = (pArg1[1] - '0') + 8;
-    uint8_t dig3 = ((pArg2[1] - '0') << 1) + (((uint8_t)(dig4)) >> 4);
-    checkConstantValid(dig4, 7, -8);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4 & 0x0F);
-
-
-return strResult;
-}
-
-/*
-The stw function, this function handles the stw opcode
-*/
-char* stw(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x3000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-
-    uint8_t dig4 = toNum(pArg3);
-    uint8_t dig2 = (pArg1[1] - '0') + 8;
-    int8_t dig3 = ((pArg2[1] - '0') << 1) + (((uint8_t)(dig4)) >> 4);
-    checkConstantValid(dig4, 7, -8);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4 & 0x0F);
-
-
-return strResult;
-}
-
-/*
-The sti function, this function handles the sti opcode
-*/
-char* sti(char* pArg1, char* pArg2, ht* table, int location){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x8000");
-
-    checkRegValid(pArg1);
-    uint8_t dig2 = (pArg1[1] - '0') + 8;
-    int16_t* labelVal = ((int16_t*)ht_get(table, pArg2));
-    if (labelVal == NULL){
-        printf("Label %s not found, terminating...", pArg2);
-        ht_destroy(table);
-        exit(3);
-    }
-    int16_t offset = (*labelVal - (location)) / 2;
-    checkConstantValid(offset,127, -128);
-    uint8_t dig3 = (uint8_t)((offset >> 4) & 0xF);
-    uint8_t dig4 = (uint8_t)(offset & 0x0F);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4);
-
-return strResult;
-}
-
-/*
-The stib function, this function handles the stib opcode
-*/
-char* stib(char* pArg1, char* pArg2, ht* table, int location){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0xE000");
-
-    checkRegValid(pArg1);
-    uint8_t dig2 = (pArg1[1] - '0') + 8;
-    int16_t* labelVal = ((int16_t*)ht_get(table, pArg2));
-    if (labelVal == NULL){
-        printf("Label %s not found, terminating...", pArg2);
-        ht_destroy(table);
-        exit(3);
-    }
-    int16_t offset = (*labelVal - (location)) / 2;
-    checkConstantValid(offset,127, -128);
-    uint8_t dig3 = (uint8_t)((offset >> 4) & 0xF);
-    uint8_t dig4 = (uint8_t)(offset & 0x0F);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4);
-
-return strResult;
-}
-
-/*
-The br function, this function handles the br opcode
-*/
-char* br(uint8_t brID, char* pArg1, ht* table, int location){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x0000");
-    int16_t* labelVal = ((int16_t*)ht_get(table, pArg1));
-    if (labelVal == NULL){
-        printf("Label %s not found, terminating...", pArg1);
-        ht_destroy(table);
-        exit(3);
-    }
-    int16_t offset = (*labelVal - (location)) / 2;
-    checkConstantValid(offset,127, -128);
-    uint8_t dig2 = brID;
-    uint8_t dig3 = (uint8_t)((offset >> 4) & 0xF);
-    uint8_t dig4 = (uint8_t)(offset & 0x0F);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4);
-
-return strResult;
-}
-
-/*
-The jmp function, this function handles the jmp opcode
-*/
-char* jmp(char* pArg1){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x6000");
-    checkRegValid(pArg1);
-    uint8_t dig3 = (pArg1[1] - '0') << 1;
-    strResult[4] = toHexString(dig3);
-return strResult;
-}
-
-
-char* jsr(char* pArg1, ht* table, int location){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x2000");
-    int16_t* labelVal = ((int16_t*)ht_get(table, pArg1));
-    if (labelVal == NULL){
-        printf("Label %s not found, terminating...", pArg1);
-        ht_destroy(table);
-        exit(3);
-    }
-    int16_t offset = (*labelVal - (location)) / 2;
-    checkConstantValid(offset,1023, -1024);
-
-    uint8_t dig2 = (offset >> 7) + 8;
-    uint8_t dig3 = (offset >> 4) & 0xF;
-    uint8_t dig4 = (offset & 0xF);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4);
-
-
-return strResult;
-}
-
-/*
-The jsrr function, this function handles the jsrr opcode
-*/
-char* jsrr(char* pArg1){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x2000");
-    checkRegValid(pArg1);
-    uint8_t dig3 = (pArg1[1] - '0') << 1;
-    strResult[4] = toHexString(dig3);
-return strResult;
-}
-
-
-/*
-The ret function, this function handles the ret opcode
-*/
-char* ret(){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x60E0");
-return strResult;
-}
-
-/*
-The rti function, this function handles the rti opcode
-*/
-char* rti(){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x4000");
-return strResult;
-}
-
-/*
-The mul function, this function handles the mul opcode
-*/
-char* mul(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x9000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-    
-    if (pArg3[0] == 'r'){ // reg version
-        uint8_t dig2 = (pArg1[1] - '0');
-        uint8_t dig3 = ((pArg2[1] - '0') << 1);
-        uint8_t dig4 = ((pArg3[1] - '0'));
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString(dig4);
-    } else { // imm version
-        uint8_t dig2 = (pArg1[1] - '0');
-        uint8_t dig3 = ((pArg2[1] - '0') << 1) + 1;
-        int8_t dig4 = toNum(pArg3);
-        checkConstantValid(dig4, 7, -8);
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString(dig4 & 0xF);
-    }
-
-return strResult;
-}
-
-/*
-The divide function, this function handles the divide opcode
-*/
-
-char* divide(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x9000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-    
-    if (pArg3[0] == 'r'){ // reg version
-        uint8_t dig2 = (pArg1[1] - '0') + 8;
-        uint8_t dig3 = ((pArg2[1] - '0') << 1);
-        uint8_t dig4 = ((pArg3[1] - '0'));
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString(dig4);
-    } else { // imm version
-        uint8_t dig2 = (pArg1[1] - '0') + 8;
-        uint8_t dig3 = ((pArg2[1] - '0') << 1) + 1;
-        int8_t dig4 = toNum(pArg3);
-        checkConstantValid(dig4, 7, -8);
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString(dig4 & 0xF);
-    }
-
-return strResult;
-}
-
-/*
-The trap function, this function handles the trap opcode
-*/
-char* trap(char* pArg1){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x7800");
-
-    int8_t dig34 = toNum(pArg1);
-    checkConstantValid(dig34,127, -128);
-    uint8_t dig3 = dig34 >> 4;
-    uint8_t dig4 = dig34 & 0xF; 
-
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4);
-return strResult;
-}
-
-/*
-The left shift function, this function handles the left shift opcode
-*/
-char* lshf(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x6000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-    
-
-        uint8_t dig2 = (pArg1[1] - '0') + 8;
-        uint8_t dig3 = ((pArg2[1] - '0') << 1);
-        int8_t dig4 = toNum(pArg3);
-        checkConstantValid(dig4, 7, 0);
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3);
-        strResult[5] = toHexString(dig4);
-
-return strResult;
-}
-
-
-
-/*
-The logical right shift function. This function handles the logical right shift opcode
-*/
-char* rshfl(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x6000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-    
-
-    uint8_t dig2 = (pArg1[1] - '0') + 8;
-    uint8_t dig3 = ((pArg2[1] - '0') << 1);
-    int8_t dig4 = toNum(pArg3);
-    checkConstantValid(dig4, 7, 0);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4+8);
-
-return strResult;
-}
-
-/*
-the arithmetic right shift function. This function handles the arithmetic right shift opcode
-*/
-char* rshfa(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0x6000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-    
-
-    uint8_t dig2 = (pArg1[1] - '0') + 8;
-    uint8_t dig3 = ((pArg2[1] - '0') << 1)+1;
-    int8_t dig4 = toNum(pArg3);
-    checkConstantValid(dig4, 7, 0);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4+8);
-
-return strResult;
-}
-
-/*
-The move function. This function handles the move opcode.
-*/
-char* mov(char* pArg1, char* pArg2){
-   char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0xA000");
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-
-    if (pArg2[0] == 'r'){ // reg version
-        uint8_t dig2 = (pArg1[1] - '0');
-        uint8_t dig4 = (pArg2[1] - '0');
-        strResult[3] = toHexString(dig2);
-        strResult[5] = toHexString(dig4);
-    } else { // imm version
-        uint8_t dig2 = (pArg1[1] - '0');
-        uint16_t imm = toNum(pArg2);
-        checkConstantValid(imm, 63, -64);
-        uint8_t dig3 = ((imm & 0x70) >> 4) + 1;
-        uint8_t dig4 = (imm & 0x0F);
-
-        strResult[3] = toHexString(dig2);
-        strResult[4] = toHexString(dig3 & 0x0F);
-        strResult[5] = toHexString(dig4 & 0x0F);
-    }
-return strResult;
-}
-
-/*
-The rotate instruction. This function handles the rotate opcode
-*/
-char* rot(char* pArg1, char* pArg2, char* pArg3){
-   char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0xA000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-    uint8_t amt = toNum(pArg3);
-    checkConstantValid(amt,31, 0);
-
-    uint8_t dig2 = (pArg1[1] - '0') + 8;
-    uint8_t dig3 = (pArg2[1] - '0') + (amt >> 4);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(amt & 0xF);
-
-
-return strResult;
-}
-
-/*
-The push instruction. This function handles the stack push opcode.
-*/
-char* push(char* pArg1){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0xB000");
-
-    checkRegValid(pArg1);
-    uint8_t dig2 = (pArg1[1] - '0');
-    strResult[3] = toHexString(dig2);
-
-return strResult;
-}
-
-/*
-The pushb instruction. This function handles the stack push byte opcode.
-*/
-char* pushb(char* pArg1){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0xB010");
-
-    checkRegValid(pArg1);
-    uint8_t dig2 = (pArg1[1] - '0');
-    strResult[3] = toHexString(dig2);
-
-return strResult;
-}
-
-/*
-The pop function. This function handles the pop stack opcode
-*/
-char* pop(char* pArg1){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0xB000");
-
-    checkRegValid(pArg1);
-    uint8_t dig2 = (pArg1[1] - '0') + 8;
-    strResult[3] = toHexString(dig2);
-
-return strResult;
-}
-
-/*
-The popb function. This function handles the pop byte stack opcode
-*/
-char* popb(char* pArg1){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0xB010");
-
-    checkRegValid(pArg1);
-    uint8_t dig2 = (pArg1[1] - '0') + 8;
-    strResult[3] = toHexString(dig2);
-
-return strResult;
-}
-
-/*
-The multiply accumulate function. This functionh handles the macc opcode
-*/
-char* macc(char* pArg1, char* pArg2, char* pArg3, char* pArg4){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0xC000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-    checkRegValid(pArg3);
-
-    uint8_t arg1 = (pArg1[1] - '0');
-    uint8_t arg2 = (pArg2[1] - '0');
-    uint8_t arg3 = (pArg3[1] - '0');
-
-    uint8_t dig2 = arg1;
-    uint8_t dig3 = (arg2 << 1) + (arg3 >> 2);
-    uint8_t dig4 = toNum(pArg4);
-    checkConstantValid(dig4, 3, 0);
-
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(dig4 + ((arg3 << 2)&0xF));
-
-return strResult;
-}
-
-/*
-The extend byte function. This function handles the extdb instruction
-*/
-char* extdb(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0xC000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-
-    uint8_t imm = toNum(pArg3);
-    checkConstantValid(imm, 15, 0);
-
-    uint8_t dig2 = (pArg1[1] - '0') + 8;
-    uint8_t dig3 = (pArg2[1] - '0') << 1;
-    
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(imm);
-
-return strResult;
-}
-
-/*
-The extend word function. This function handles the extdw opcode.
-*/
-char* extdw(char* pArg1, char* pArg2, char* pArg3){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, "0xD000");
-
-    checkRegValid(pArg1);
-    checkRegValid(pArg2);
-
-    uint8_t imm = toNum(pArg3);
-    checkConstantValid(imm, 7, 0);
-
-    uint8_t dig2 = (pArg1[1] - '0');
-    uint8_t dig3 = (pArg2[1] - '0') << 1;
-    
-    strResult[3] = toHexString(dig2);
-    strResult[4] = toHexString(dig3);
-    strResult[5] = toHexString(imm);
-
-return strResult;
-}
-
-/*
-The block word pseudo op function. This function handles the pseudo opcode .blkw.
-*/
-char* blkw(char* pArg1, FILE** output, int* pOffset){
-uint16_t numWords = toNum(pArg1);
-
-for (int i = 0; i < numWords; ++i){
-    fprintf(*output, "%s\n", "0x0000");
-    *pOffset += 2;
-}
-
-return NULL;
-}
-
-/**
- *The fill pseudo op function. This function handles the pseudo opcode .fill
- * 
- */
-char* fill(char* pArg1){
-    char* strResult = (char*)malloc((sizeof(char) * 7));
-    strcpy(strResult, pArg1);
-return strResult;
-}
-
-/*
-The stringz pseudo op function. This function handles the pseudo opcode .stringz
-*/
-char* stringz(char* pArg1, FILE** output, int* pOffset){
-    uint16_t itr = 0;
-
-    while (pArg1[itr] != 0){
-        char tmpStr[] = "0x0000";
-        char firstChar = pArg1[itr];
-        uint8_t dig4 = firstChar & 0xF;
-        uint8_t dig3 = firstChar >> 4;
-        tmpStr[4] = toHexString(dig3);
-        tmpStr[5] = toHexString(dig4);
-        ++itr;
-        if (pArg1[itr] != 0){
-            char secondChar = pArg1[itr];
-            uint8_t dig2 = secondChar & 0xF;
-            uint8_t dig1 = secondChar >> 4;
-            tmpStr[3] = toHexString(dig2);
-            tmpStr[2] = toHexString(dig1);
-            ++itr;
-        }
-        fprintf(*output, "%s\n", tmpStr);
-        *pOffset += 2;
-        }
-    return NULL;
-}
\ No newline at end of file
+#include "assembler.h"
+#include "threadpool.h"
+#include "ir.h"
+#include "isa.h"
+#include <stdatomic.h>
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+// Lines in each chunk the second pass is split into, every chunk is one task
+#ifndef CHUNK_LINES
+#define CHUNK_LINES 8192
+#endif
+
+// The label table is sized up front for one label every this many lines
+#ifndef LINES_PER_LABEL
+#define LINES_PER_LABEL 4
+#endif
+
+/*
+Where a chunk of the second pass starts. The first pass records one every
+CHUNK_LINES lines up to .end, so the chunks can be encoded independently.
+*/
+typedef struct {
+    size_t first; // IR index of the first line of the chunk
+    int offset;   // label offset before the chunk
+    int extra;    // words .blkw and .stringz added to the second pass offset before the chunk, in bytes
+} chunk;
+
+typedef struct {
+    chunk* items;
+    size_t length;
+    size_t capacity;
+} chunk_list;
+
+static void firstPass(symtab* table, const asm_ir* ir, int orig, chunk_list* chunks, threadpool* pool,
+asm_stats* stats, diag_list* diags);
+static void secondPass(symtab* table, const asm_ir* ir, int orig, image* output, const chunk_list* chunks,
+threadpool* pool, asm_stats* stats, diag_list* diags);
+static void singlePass(symtab* table, source* input, image* output, asm_stats* stats, diag_list* diags);
+static int findOrig(source* input, asm_stats* stats, diag_list* diags);
+static void addPhase(asm_stats* stats, int phase, double start, size_t lines, size_t bytes);
+static int irOrig(const asm_ir* ir, asm_stats* stats, diag_list* diags);
+static int selectOpFunc(int opcode, token opCode, token pArg1, token pArg2, token pArg3, token pArg4,
+image* output, symtab* table, const ir_line* line, int* offset, int location, diag_list* diags);
+static uint16_t encodeForm(const isa_form* form, const token args[4], const ir_line* line, symtab* table, int location,
+diag_list* diags);
+static void blkw(token pArg1, image* output, int* pOffset, diag_list* diags);
+static uint16_t fill(token pArg1, diag_list* diags);
+static void stringz(token pArg1, image* output, int* pOffset, diag_list* diags);
+
+// returned by selectOpFunc for opcodes that don't produce a single word
+#define NO_WORD -1
+
+/*
+Looks up the address of a label operand, by its symbol id when the IR has one for it.
+*/
+static bool findLabel(symtab* table, token label, int32_t labelId, uint16_t* address){
+    if (labelId != IR_NO_LABEL){
+        return symtab_address(table, labelId, address);
+    }
+    return symtab_get(table, label.ptr, label.len, address);
+}
+
+/*
+Checks is a given label is valid.
+*/
+static bool checkLabel(token label_str, diag_list* diags){
+    if (!isValidLabel(label_str)){
+        char lower[DIAG_MESSAGE_LENGTH];
+        return diag_report(diags, 4, "Invalid label %s, terminating...", lowerToken(label_str, lower, sizeof(lower)));
+    }
+    return true;
+}
+
+static int add_label_increment(int opcode, token pArg1, diag_list* diags){
+    if (opcode == BLKW){
+        int blkwrd_cnt = toNum(pArg1, diags);
+        return blkwrd_cnt * 2;
+    } else if (opcode == STRINGZ){
+        size_t str_len = pArg1.len;
+        return (str_len + 1) & 0xFFFE;
+    } else {
+        return 2;
+    }
+}
+
+/*
+Appends a word to the assembled image, reports an error if we run out of memory.
+*/
+static bool emitWord(image* output, diag_list* diags, uint16_t word){
+    if (!image_push(output, word)){
+        return diag_report(diags, 4, "Out of memory, terminating...");
+    }
+    return true;
+}
+
+// Tables and buffers kept from one assembly to the next
+struct asm_workspace {
+    arena* symbols;      // owns the label keys
+    symtab* table;       // labels of the program being assembled
+    asm_ir ir;           // lexed source of the two pass assembler
+    chunk_list chunks;   // chunks of the second pass
+    threadpool* pool;    // encodes the chunks, kept warm between assemblies, NULL until needed
+};
+
+asm_workspace* asm_workspace_create(void){
+    asm_workspace* ws = calloc(1, sizeof(asm_workspace));
+    if (ws == NULL){
+        return NULL;
+    }
+    stats_count_alloc(1);
+    ir_init(&ws->ir);
+    ws->symbols = arena_create();
+    ws->table = ws->symbols != NULL ? symtab_create(ws->symbols) : NULL;
+    if (ws->table == NULL){
+        asm_workspace_destroy(ws);
+        return NULL;
+    }
+    return ws;
+}
+
+void asm_workspace_destroy(asm_workspace* ws){
+    if (ws->table != NULL){
+        symtab_destroy(ws->table);
+    }
+    arena_destroy(ws->symbols);
+    pool_destroy(ws->pool);
+    ir_free(&ws->ir);
+    free(ws->chunks.items);
+    free(ws);
+}
+
+/*
+Return a pool with enough threads to run the given number of tasks, NULL if they're
+run on the calling thread. The pool only ever grows, so a workspace reused for many
+sources starts its threads once.
+*/
+static threadpool* workspacePool(asm_workspace* ws, int threads, size_t tasks){
+    threads = MIN(threads, (int)MIN(tasks, 1024));
+    if (threads <= 1){
+        return NULL;
+    }
+    if (pool_size(ws->pool) < threads){
+        pool_destroy(ws->pool);
+        ws->pool = pool_create(threads);
+    }
+    return ws->pool;
+}
+
+/*
+The main function of this file, this handles the actually assembly process. The
+source is assembled into output and any errors are added to diags. Nothing here
+touches global state, so several sources can be assembled at once from different
+threads as long as each uses its own workspace.
+*/
+static bool assembleIn(asm_workspace* ws, source* input, const asm_options* options, image* output, diag_list* diags){
+    // a source assembled before comes straight from the cache, without being read
+    cache_key key;
+    size_t first = output->length, firstRegion = output->region_count;
+    if (options->cacheDir != NULL){
+        key = cache_hash(input->data, input->size, ASSEMBLER_VERSION);
+        if (cache_load(options->cacheDir, key, input->size, output)){
+            if (options->stats != NULL){
+                options->stats->assemblies++;
+                options->stats->cacheHits++;
+            }
+            return true;
+        }
+    }
+
+    arena_reset(ws->symbols);
+    symtab_clear(ws->table);
+    ws->chunks.length = 0;
+
+    ht_stats before;
+    if (options->stats != NULL){
+        symtab_info(ws->table, &before);
+    }
+    if (!symtab_reserve(ws->table, countLines(input) / LINES_PER_LABEL)){
+        return diag_report(diags, 4, "Out of memory, terminating...");
+    }
+
+    if (options->passMode == SINGLE_PASS){
+        singlePass(ws->table, input, output, options->stats, diags);
+    } else {
+        int threads = options->threads > 0 ? options->threads : cpu_count();
+        double start = options->stats != NULL ? stats_now() : 0;
+        if (!ir_build(&ws->ir, input, ws->table, workspacePool(ws, threads, input->size / IR_SEGMENT_BYTES + 1))){
+            return diag_report(diags, 4, "Out of memory, terminating...");
+        }
+        if (options->stats != NULL){
+            addPhase(options->stats, PHASE_LEX, start, ws->ir.total, ws->ir.size);
+        }
+        int orig = irOrig(&ws->ir, options->stats, diags);
+        if (!diag_failed(diags)){
+            firstPass(ws->table, &ws->ir, orig, &ws->chunks, workspacePool(ws, threads, ws->ir.length / CHUNK_LINES + 1),
+                options->stats, diags);
+        }
+        if (!diag_failed(diags)){
+            secondPass(ws->table, &ws->ir, orig, output, &ws->chunks, workspacePool(ws, threads, ws->chunks.length),
+                options->stats, diags);
+        }
+    }
+
+    if (options->stats != NULL){
+        asm_stats run = {0};
+        run.assemblies = 1;
+        symtab_info(ws->table, &run.labels);
+        run.labels.expansions -= before.expansions;
+        stats_add(options->stats, &run);
+    }
+    if (options->cacheDir != NULL && !diag_failed(diags)){
+        cache_store(options->cacheDir, key, input->size, output, first, firstRegion);
+    }
+    return !diag_failed(diags);
+}
+
+bool assembleWith(asm_workspace* ws, source* input, const asm_options* options, image* output, diag_list* diags){
+    // allocations are counted into the stats of this assembly, and only if it has some
+    size_t* outer = stats_count_into(options->stats != NULL ? &options->stats->allocations : NULL);
+    bool ok = assembleIn(ws, input, options, output, diags);
+    stats_count_into(outer);
+    return ok;
+}
+
+bool assembleSource(source* input, const asm_options* options, image* output, diag_list* diags){
+    asm_workspace* ws = asm_workspace_create();
+    if (ws == NULL){
+        return diag_report(diags, 4, "Out of memory, terminating...");
+    }
+    bool ok = assembleWith(ws, input, options, output, diags);
+    asm_workspace_destroy(ws);
+    return ok;
+}
+
+bool assembleBuffer(const char* text, size_t size, const asm_options* options, image* output, diag_list* diags){
+    source input;
+    openBuffer(&input, text, size);
+    bool ok = assembleSource(&input, options, output, diags);
+    closeSource(&input);
+    return ok;
+}
+
+// Add the time since start and the lines and bytes read to a phase
+static void addPhase(asm_stats* stats, int phase, double start, size_t lines, size_t bytes){
+    stats->seconds[phase] += stats_now() - start;
+    stats->lines[phase] += lines;
+    stats->bytes[phase] += bytes;
+}
+
+// Record a chunk starting at line first of the IR, return false if out of memory
+static bool addChunk(chunk_list* chunks, size_t first, int offset, int extra){
+    if (chunks->length == chunks->capacity){
+        size_t new_capacity = chunks->capacity ? chunks->capacity * 2 : 8;
+        chunk* new_items = realloc(chunks->items, new_capacity * sizeof(chunk));
+        if (new_items == NULL){
+            return false;
+        }
+        stats_count_alloc(1);
+        chunks->items = new_items;
+        chunks->capacity = new_capacity;
+    }
+    chunk* start = &chunks->items[chunks->length++];
+    start->first = first;
+    start->offset = offset;
+    start->extra = extra;
+    return true;
+}
+
+/*
+Find the .orig line in the IR and return its address, the two pass version of findOrig.
+If there is no .orig found then an error is reported and -1 returned
+*/
+static int irOrig(const asm_ir* ir, asm_stats* stats, diag_list* diags){
+    double start = stats != NULL ? stats_now() : 0;
+    if (ir->orig == ir->length){
+        diags->line = 0;
+        diag_report(diags, 4, "Did not find start of program, terminating...");
+        return -1;
+    }
+    token args[4];
+    ir_operands(ir, ir->orig, args);
+    diags->line = ir->lines[ir->orig].line;
+    if (stats != NULL){
+        addPhase(stats, PHASE_FIND_ORIG, start, ir->lines[ir->orig].line, ir->lines[ir->orig].pos);
+    }
+    return toNum(args[0], diags);
+}
+
+/*
+Return the bytes line index of the IR takes up in memory, working it out from the
+text with add_label_increment when the IR has no value for it.
+*/
+static int lineIncrement(const asm_ir* ir, size_t index, diag_list* diags){
+    const ir_line* line = &ir->lines[index];
+    if (line->opcode == BLKW && ir_kind(line, 0) == OPERAND_NUMBER){
+        return line->args[0].value * 2;
+    } else if (line->opcode == STRINGZ && !(line->flags & IR_LONG_LINE)){
+        return (line->args[0].length + 1) & 0xFFFE;
+    } else if (line->opcode == BLKW || line->opcode == STRINGZ){
+        token args[4];
+        ir_operands(ir, index, args);
+        return add_label_increment(line->opcode, args[0], diags);
+    }
+    return 2;
+}
+
+// Return the bytes .blkw and .stringz move the second pass offset by, 0 for anything else
+static int lineExtra(int opcode, int increment){
+    if (opcode == BLKW){
+        return 2 * (uint16_t)(increment / 2);
+    } else if (opcode == STRINGZ){
+        return increment;
+    }
+    return 0;
+}
+
+/*
+Gives the labels their address in memory one line after the other. The IR already
+interned them so each is just stored by its id. Errors are reported for the first
+line that has one.
+*/
+static void collectLabels(symtab* table, const asm_ir* ir, int orig, chunk_list* chunks, diag_list* diags){
+    int offset = 0, extra = 0, lines = 0;
+    bool ended = false;
+    token pLabel, pOpcode, args[4];
+
+    for (size_t i = ir->orig + 1; i < ir->length; ++i){
+        const ir_line* line = &ir->lines[i];
+        if (!ended && lines++ % CHUNK_LINES == 0){
+            if (!addChunk(chunks, i, offset, extra)){
+                diag_report(diags, 4, "Out of memory, terminating...");
+                return;
+            }
+        }
+        diags->line = line->line;
+        if (line->flags & IR_BAD_LABEL){
+            ir_relex(ir, i, &pLabel, &pOpcode, args);
+            checkLabel(pLabel, diags);
+            return;
+        }
+        if (line->label != IR_NO_LABEL && symtab_define(table, line->label, orig + offset) == SYM_EXISTS){
+            ir_relex(ir, i, &pLabel, &pOpcode, args);
+            char lower[DIAG_MESSAGE_LENGTH];
+            diag_report(diags, 4, "Multiple label instances (%s), terminating...", lowerToken(pLabel, lower, sizeof(lower)));
+            return;
+        }
+
+        int increment = lineIncrement(ir, i, diags);
+        if (diag_failed(diags)){
+            return;
+        }
+        offset += increment;
+
+        // .blkw and .stringz move the second pass offset by the words they emit
+        extra += lineExtra(line->opcode, increment);
+        if (line->opcode == END){
+            ended = true;
+        }
+    }
+}
+
+// Shared state of the tasks of the parallel first pass
+typedef struct {
+    symtab* table;
+    const asm_ir* ir;
+    chunk_list* chunks;
+    int orig;
+    atomic_bool failed;   // a chunk has an error or a label defined twice
+    atomic_size_t ended;  // first chunk with the .end, chunks->length if none
+} label_job;
+
+// Add up the bytes a chunk takes up and moves the second pass offset by, into its offset and extra
+static void sizeChunk(void* arg, size_t index, int thread){
+    label_job* job = arg;
+    (void)thread;
+    const asm_ir* ir = job->ir;
+    chunk* start = &job->chunks->items[index];
+    size_t end = index + 1 < job->chunks->length ? job->chunks->items[index + 1].first : ir->length;
+    int offset = 0, extra = 0;
+    for (size_t i = start->first; i < end; ++i){
+        const ir_line* line = &ir->lines[i];
+        // anything that may be an error is left to collectLabels to report in order
+        if ((line->flags & IR_BAD_LABEL) || (line->opcode == BLKW && ir_kind(line, 0) != OPERAND_NUMBER)){
+            atomic_store(&job->failed, true);
+            return;
+        }
+        int increment = lineIncrement(ir, i, NULL);
+        offset += increment;
+        extra += lineExtra(line->opcode, increment);
+        if (line->opcode == END){
+            size_t ended = atomic_load(&job->ended);
+            while (index < ended && !atomic_compare_exchange_weak(&job->ended, &ended, index)){
+            }
+        }
+    }
+    start->offset = offset;
+    start->extra = extra;
+}
+
+// Give the labels of a chunk their address, counting up from the offset before the chunk
+static void defineChunk(void* arg, size_t index, int thread){
+    label_job* job = arg;
+    (void)thread;
+    const asm_ir* ir = job->ir;
+    const chunk* start = &job->chunks->items[index];
+    size_t end = index + 1 < job->chunks->length ? job->chunks->items[index + 1].first : ir->length;
+    int offset = start->offset;
+    for (size_t i = start->first; i < end; ++i){
+        const ir_line* line = &ir->lines[i];
+        if (line->label != IR_NO_LABEL && symtab_define(job->table, line->label, job->orig + offset) == SYM_EXISTS){
+            atomic_store(&job->failed, true);
+            return;
+        }
+        offset += lineIncrement(ir, i, NULL);
+    }
+}
+
+/*
+Gives the labels their address with the chunks worked on in parallel. Every chunk
+adds up its size on its own, a prefix sum over them gives the offset each starts
+at, then the chunks define their labels. Return false if a chunk hit an error or
+a label defined twice, which collectLabels then reports as it finds the first one.
+*/
+static bool collectLabelsParallel(symtab* table, const asm_ir* ir, int orig, chunk_list* chunks, threadpool* pool,
+diag_list* diags){
+    for (size_t i = ir->orig + 1; i < ir->length; i += CHUNK_LINES){
+        if (!addChunk(chunks, i, 0, 0)){
+            diag_report(diags, 4, "Out of memory, terminating...");
+            return true;
+        }
+    }
+
+    label_job job;
+    job.table = table;
+    job.ir = ir;
+    job.chunks = chunks;
+    job.orig = orig;
+    atomic_init(&job.failed, false);
+    atomic_init(&job.ended, chunks->length);
+    pool_run(pool, sizeChunk, &job, chunks->length);
+    if (atomic_load(&job.failed)){
+        return false;
+    }
+
+    int offset = 0, extra = 0;
+    for (size_t i = 0; i < chunks->length; ++i){
+        chunk* start = &chunks->items[i];
+        int size = start->offset, moved = start->extra;
+        start->offset = offset;
+        start->extra = extra;
+        offset += size;
+        extra += moved;
+    }
+
+    pool_run(pool, defineChunk, &job, chunks->length);
+    if (atomic_load(&job.failed)){
+        return false;
+    }
+    // the second pass stops at the .end, so no chunks after it
+    size_t ended = atomic_load(&job.ended);
+    if (ended < chunks->length){
+        chunks->length = ended + 1;
+    }
+    return true;
+}
+
+/*
+The first pass of the assembly process. This pass is used for giving the labels their
+address in memory, these will be used in the second pass of the assembly process. It
+also splits the program into chunks for the second pass, tracking how far .blkw and
+.stringz moved the second pass offset by the start of each of them. Given a pool the
+chunks are worked on in parallel, falling back to going through them in order to
+report the first error when there is one.
+*/
+static void firstPass(symtab* table, const asm_ir* ir, int orig, chunk_list* chunks, threadpool* pool,
+asm_stats* stats, diag_list* diags){
+    double start = stats != NULL ? stats_now() : 0;
+    if (pool == NULL){
+        collectLabels(table, ir, orig, chunks, diags);
+    } else if (!collectLabelsParallel(table, ir, orig, chunks, pool, diags)){
+        symtab_undefine(table);
+        chunks->length = 0;
+        collectLabels(table, ir, orig, chunks, diags);
+    }
+    if (stats != NULL && ir->orig < ir->length){
+        const ir_line* origLine = &ir->lines[ir->orig];
+        addPhase(stats, PHASE_FIRST_PASS, start, ir->total - origLine->line, ir->size - origLine->pos);
+    }
+}
+
+/*
+This function is used for finding the .orig opcode in the given file as this marks the start of 
+the assembly process. If there is no .orig found then an error is reported and -1 returned
+*/
+static int findOrig(source* input, asm_stats* stats, diag_list* diags){
+    int lret, opcode;
+    token pLabel, pOpcode, pArg1, pArg2, pArg3, pArg4;
+    double start = stats != NULL ? stats_now() : 0;
+
+    do {
+        lret = readAndParse(input, &pLabel, &pOpcode, &pArg1, &pArg2, &pArg3, &pArg4, &opcode);
+        diags->line = input->line;
+        if (lret != DONE && lret != EMPTY_LINE){
+            if (opcode == ORIG){
+                if (stats != NULL){
+                    addPhase(stats, PHASE_FIND_ORIG, start, input->line, input->pos);
+                }
+                return toNum(pArg1, diags);
+            }
+        }
+
+    } while(lret != DONE);
+
+    diags->line = 0;
+    diag_report(diags, 4, "Did not find start of program, terminating...");
+return -1;
+}
+
+// Shared state of the chunk tasks of the second pass
+typedef struct {
+    symtab* table;
+    const asm_ir* ir;
+    const chunk_list* chunks;
+    int orig;
+    image** images;         // output of every chunk, images[0] is the final image
+    diag_list* diags;       // errors of every chunk
+    atomic_size_t failed;   // lowest chunk with an error so far, chunks->length if none
+    bool counting;          // add up lines and bytes below, only when collecting stats
+    atomic_size_t lines;    // lines encoded by every chunk
+    atomic_size_t bytes;    // bytes encoded by every chunk
+} pass_job;
+
+/*
+Encodes a single chunk of the second pass into its own image. Chunks after one that
+already failed are skipped as their output is thrown away. Every source line moves
+the offset on by 2, blank ones included, so a line's offset comes from its line
+number plus the words .blkw and .stringz emitted before it.
+*/
+static void encodeChunk(void* arg, size_t index, int thread){
+    pass_job* job = arg;
+    (void)thread;
+    if (index > atomic_load(&job->failed)){
+        return;
+    }
+    const asm_ir* ir = job->ir;
+    const chunk* start = &job->chunks->items[index];
+    size_t end = index + 1 < job->chunks->length ? job->chunks->items[index + 1].first : ir->length;
+    image* output = job->images[index];
+    diag_list* diags = &job->diags[index];
+    int origLine = (int)ir->lines[ir->orig].line;
+
+    int extra = start->extra;
+    token pLabel, pOpcode = {"", 0}, args[4];
+    size_t i = start->first;
+    for (; i < end; ++i){
+        const ir_line* line = &ir->lines[i];
+        diags->line = line->line;
+        if (line->opcode == ORIG || line->opcode == NUM_OPCODES){
+            ir_relex(ir, i, &pLabel, &pOpcode, args); // only for the text of the error
+        } else {
+            ir_operands(ir, i, args);
+        }
+        int offset = 2 * ((int)line->line - origLine) + extra;
+        int before = offset;
+        int word = selectOpFunc(line->opcode, pOpcode, args[0], args[1], args[2], args[3], output, job->table, line,
+            &offset, job->orig+offset, diags);
+        extra += offset - before;
+        if (diag_failed(diags)){
+            break;
+        }
+        if (word == NO_WORD){
+            if (line->opcode == END){
+                break;
+            }
+        } else if (!emitWord(output, diags, word)){
+            break;
+        }
+    }
+
+    if (job->counting && start->first < end){
+        size_t last = i < end ? i : end - 1;
+        atomic_fetch_add(&job->lines, (size_t)(ir->lines[last].line - ir->lines[start->first].line + 1));
+        size_t endPos = last + 1 < ir->length ? ir->lines[last + 1].pos : ir->size;
+        atomic_fetch_add(&job->bytes, endPos - ir->lines[start->first].pos);
+    }
+    if (diag_failed(diags)){
+        size_t failed = atomic_load(&job->failed);
+        while (index < failed && !atomic_compare_exchange_weak(&job->failed, &failed, index)){
+        }
+    }
+}
+
+/*
+This handles the second pass of the assembly process. This is the
+ pass where the majority of the work is done. Each line in the file corresponds to a
+ single assembly instruction. First the specific opcode is determined and depending
+ on the opcode we call a function corresponding to it that will return the machine
+ code word of that assembly instruction, this will be appended to the output image.
+ The chunks found by the first pass are encoded in parallel and joined in order, the
+ errors of the earliest failing chunk are the ones reported.
+*/
+static void secondPass(symtab* table, const asm_ir* ir, int orig, image* output, const chunk_list* chunks,
+threadpool* pool, asm_stats* stats, diag_list* diags){
+    double start = stats != NULL ? stats_now() : 0;
+    output->orig = orig;
+    if (chunks->length == 0){
+        return;
+    }
+
+    pass_job job;
+    job.table = table;
+    job.ir = ir;
+    job.chunks = chunks;
+    job.orig = orig;
+    job.images = calloc(chunks->length, sizeof(image*));
+    job.diags = calloc(chunks->length, sizeof(diag_list));
+    atomic_init(&job.failed, chunks->length);
+    job.counting = stats != NULL;
+    atomic_init(&job.lines, 0);
+    atomic_init(&job.bytes, 0);
+    if (job.images == NULL || job.diags == NULL){
+        free(job.images);
+        free(job.diags);
+        diag_report(diags, 4, "Out of memory, terminating...");
+        return;
+    }
+    stats_count_alloc(2);
+    job.images[0] = output;
+    for (size_t i = 0; i < chunks->length; ++i){
+        diag_init(&job.diags[i]);
+        if (i > 0 && (job.images[i] = image_create()) == NULL){
+            diag_report(&job.diags[i], 4, "Out of memory, terminating...");
+            atomic_init(&job.failed, MIN(atomic_load(&job.failed), i));
+        }
+    }
+
+    pool_run(pool, encodeChunk, &job, chunks->length);
+
+    size_t failed = atomic_load(&job.failed);
+    for (size_t i = 1; i < chunks->length; ++i){
+        if (job.images[i] == NULL){
+            continue;
+        }
+        if (i < failed && !image_append(output, job.images[i])){
+            diag_report(&job.diags[i], 4, "Out of memory, terminating...");
+            failed = i;
+        }
+        image_destroy(job.images[i]);
+    }
+    if (failed < chunks->length){
+        diag_append(diags, &job.diags[failed]);
+    }
+    for (size_t i = 0; i < chunks->length; ++i){
+        diag_free(&job.diags[i]);
+    }
+    free(job.images);
+    free(job.diags);
+    if (stats != NULL){
+        addPhase(stats, PHASE_SECOND_PASS, start, atomic_load(&job.lines), atomic_load(&job.bytes));
+    }
+}
+
+/*
+A forward reference left behind by the single pass. The instruction is re-encoded
+into its placeholder slot in the output once its label gets defined.
+*/
+typedef struct fixup {
+    size_t index;   // index of the placeholder word in the image
+    int location;   // location the instruction was encoded at
+    int line;       // source line, used to report the first undefined label
+    int opcode;
+    token pArg1;    // operands point into the source, which outlives the fixup
+    token pArg2;
+    struct fixup* next;
+} fixup;
+
+// Pending fixups for a single label, the value type of the fixup table
+typedef struct {
+    fixup* head;
+    fixup** tail;   // next pointer of the last fixup, they're kept in source order
+} fixup_list;
+
+/*
+Returns the label operand of the given opcode, or NULL if the opcode doesn't
+reference a label.
+*/
+static token* labelOperand(int opcode, token* pArg1, token* pArg2){
+    switch (ir_label_operand(opcode)){
+        case 0: return pArg1;
+        case 1: return pArg2;
+        default: return NULL;
+    }
+}
+
+/*
+Defines a label during the single pass and patches every instruction that referenced
+it before it was defined.
+*/
+static void defineLabel(symtab* table, ht* fixup_table, token pLabel, int address, image* output, diag_list* diags){
+    if (!checkLabel(pLabel, diags)){
+        return;
+    }
+    int added = symtab_add(table, pLabel.ptr, pLabel.len, address);
+    if (added == SYM_EXISTS){
+        char lower[DIAG_MESSAGE_LENGTH];
+        diag_report(diags, 4, "Multiple label instances (%s), terminating...", lowerToken(pLabel, lower, sizeof(lower)));
+        return;
+    } else if (added == SYM_NO_MEMORY){
+        diag_report(diags, 4, "Out of memory, terminating...");
+        return;
+    }
+
+    fixup_list* pending = (fixup_list*)ht_getn(fixup_table, pLabel.ptr, pLabel.len);
+    if (pending == NULL || pending->head == NULL){
+        return;
+    }
+
+    // errors in a patched instruction belong to its line, not the label's
+    int labelLine = diags->line;
+    while (pending->head != NULL){
+        fixup* fix = pending->head;
+        int fixOffset = 0;
+        token none = {"", 0};
+        diags->line = fix->line;
+        output->words[fix->index] = selectOpFunc(fix->opcode, none, fix->pArg1, fix->pArg2, none, none,
+            output, table, NULL, &fixOffset, fix->location, diags);
+
+        pending->head = fix->next;
+    }
+    diags->line = labelLine;
+}
+
+/*
+Records a forward reference to a label that hasn't been defined yet and writes
+a placeholder word in its place.
+*/
+static void deferInstruction(ht* fixup_table, arena* fixups, token pLabelRef, int opcode, token pArg1,
+token pArg2, int location, int line, image* output, diag_list* diags){
+    fixup_list* pending = (fixup_list*)ht_getn(fixup_table, pLabelRef.ptr, pLabelRef.len);
+    if (pending == NULL){
+        pending = (fixup_list*)arena_calloc(fixups, sizeof(fixup_list));
+        if (pending == NULL || ht_setn(fixup_table, pLabelRef.ptr, pLabelRef.len, pending) == NULL){
+            diag_report(diags, 4, "Out of memory, terminating...");
+            return;
+        }
+    }
+
+    fixup* fix = (fixup*)arena_alloc(fixups, sizeof(fixup));
+    if (fix == NULL){
+        diag_report(diags, 4, "Out of memory, terminating...");
+        return;
+    }
+    fix->index = output->length;
+    fix->location = location;
+    fix->line = line;
+    fix->opcode = opcode;
+    fix->pArg1 = pArg1;
+    fix->pArg2 = pArg2;
+    fix->next = NULL;
+    *(pending->tail != NULL ? pending->tail : &pending->head) = fix;
+    pending->tail = &fix->next;
+
+    emitWord(output, diags, 0x0000);
+}
+
+/*
+Assembles the file in a single read. Each instruction is encoded as soon as it is parsed,
+references to labels that are not yet defined get a placeholder which is patched when the
+label shows up. Addresses and locations are tracked exactly like firstPass and secondPass
+so the output is identical to the two pass assembly.
+*/
+static void singlePass(symtab* table, source* input, image* output, asm_stats* stats, diag_list* diags){
+    int orig = findOrig(input, stats, diags);
+    if (diag_failed(diags)){
+        return;
+    }
+    double start = stats != NULL ? stats_now() : 0;
+    size_t startPos = input->pos;
+    int startLine = input->line;
+    output->orig = orig;
+
+    // the fixups and their lists live in an arena that goes away with the table
+    arena* fixups = arena_create();
+    ht* fixup_table = fixups != NULL ? ht_create_arena(fixups) : NULL;
+    if (fixup_table == NULL){
+        arena_destroy(fixups);
+        diag_report(diags, 4, "Out of memory, terminating...");
+        return;
+    }
+    int lret, opcode, offset = 0, labelOffset = 0;
+    bool ended = false;
+    token pLabel, pOpcode, pArg1, pArg2, pArg3, pArg4;
+    do {
+        if (!ended){
+            offset += 2;
+        }
+        lret = readAndParse(input, &pLabel, &pOpcode, &pArg1, &pArg2, &pArg3, &pArg4, &opcode);
+        diags->line = input->line;
+        if (lret == DONE || lret == EMPTY_LINE){
+            continue;
+        }
+
+        if (pLabel.len > 0){
+            defineLabel(table, fixup_table, pLabel, orig + labelOffset, output, diags);
+        }
+        labelOffset += add_label_increment(opcode, pArg1, diags);
+        if (diag_failed(diags)){
+            break;
+        }
+        if (ended){
+            continue;
+        }
+
+        token* pLabelRef = labelOperand(opcode, &pArg1, &pArg2);
+        uint16_t address;
+        if (pLabelRef != NULL && !symtab_get(table, pLabelRef->ptr, pLabelRef->len, &address)){
+            deferInstruction(fixup_table, fixups, *pLabelRef, opcode, pArg1, pArg2, orig + offset, input->line, output, diags);
+        } else {
+            int word = selectOpFunc(opcode, pOpcode, pArg1, pArg2, pArg3, pArg4, output, table, NULL, &offset, orig+offset, diags);
+            if (word == NO_WORD){
+                if (opcode == END){
+                    ended = true;
+                }
+            } else if (!diag_failed(diags)){
+                emitWord(output, diags, word);
+            }
+        }
+        if (diag_failed(diags)){
+            break;
+        }
+    } while(lret != DONE);
+
+    // anything still pending references a label that was never defined
+    fixup* first = NULL;
+    hti it = ht_iterator(fixup_table);
+    while (!diag_failed(diags) && ht_next(&it)){
+        for (fixup* fix = ((fixup_list*)it.value)->head; fix != NULL; fix = fix->next){
+            if (first == NULL || fix->line < first->line){
+                first = fix;
+            }
+        }
+    }
+    if (first != NULL){
+        token* pLabelRef = labelOperand(first->opcode, &first->pArg1, &first->pArg2);
+        diags->line = first->line;
+        char lower[DIAG_MESSAGE_LENGTH];
+        diag_report(diags, 3, "Label %s not found, terminating...", lowerToken(*pLabelRef, lower, sizeof(lower)));
+    }
+    ht_destroy(fixup_table);
+    arena_destroy(fixups);
+    // there is only one pass, it's counted as the second as that's where the encoding is
+    if (stats != NULL){
+        addPhase(stats, PHASE_SECOND_PASS, start, input->line - startLine, input->pos - startPos);
+    }
+}
+
+/*
+Incremental reassembly. A document keeps every line of the source along with what the
+passes derived from it: its parse, its first pass address increment and the words it
+encodes to. An edit re-parses only the lines it inserts. Addresses and locations are
+then recomputed for every line, which is cheap integer work, and only new lines and
+PC-relative instructions whose distance to their label changed get encoded again.
+*/
+
+// Lines inserted by one edit, shared by those lines and freed once the last one goes
+typedef struct {
+    size_t refs;     // lines still pointing into data
+    char data[];     // the inserted text, every line ending in '\n'
+} text_block;
+
+// A line of a document and everything the passes need from it
+typedef struct {
+    text_block* block;  // holds the text the tokens point into
+    const char* text;   // start of the line in block
+    size_t length;      // length of the line without its newline
+    int lret;           // readAndParse result, OK or EMPTY_LINE
+    int opcode;
+    token label, op, args[4];
+    int increment;      // first pass address increment, from add_label_increment
+    bool bad;           // the increment couldn't be worked out, the line has an error
+    bool encoded;       // words hold the encoding at delta
+    int delta;          // label address minus location when last encoded, 0 without a label
+    size_t count;       // number of words the line encodes to
+    uint16_t word;      // the word of single word lines
+    uint16_t* words;    // the words of lines with more than one, NULL otherwise
+} doc_line;
+
+struct asm_document {
+    doc_line* lines;
+    size_t length;
+    size_t capacity;
+    asm_workspace* ws;  // label table of the document
+    image* scratch;     // words of the line being encoded
+    asm_options options;
+};
+
+asm_document* asm_document_create(const asm_options* options){
+    asm_document* doc = calloc(1, sizeof(asm_document));
+    if (doc == NULL){
+        return NULL;
+    }
+    stats_count_alloc(1);
+    doc->options = *options;
+    doc->options.stats = NULL;
+    doc->ws = asm_workspace_create();
+    doc->scratch = image_create();
+    if (doc->ws == NULL || doc->scratch == NULL){
+        asm_document_destroy(doc);
+        return NULL;
+    }
+    return doc;
+}
+
+// Drop a line's words and its hold on its text
+static void releaseLine(doc_line* line){
+    free(line->words);
+    if (--line->block->refs == 0){
+        free(line->block);
+    }
+}
+
+void asm_document_destroy(asm_document* doc){
+    for (size_t i = 0; i < doc->length; ++i){
+        releaseLine(&doc->lines[i]);
+    }
+    free(doc->lines);
+    if (doc->ws != NULL){
+        asm_workspace_destroy(doc->ws);
+    }
+    if (doc->scratch != NULL){
+        image_destroy(doc->scratch);
+    }
+    free(doc);
+}
+
+size_t asm_document_lines(asm_document* doc){
+    return doc->length;
+}
+
+// Return the number of lines in size bytes of text, a last line without '\n' counts
+static size_t countTextLines(const char* text, size_t size){
+    source lines;
+    openBuffer(&lines, text, size);
+    return countLines(&lines);
+}
+
+/*
+Replace removed lines from first on with the lines of text, parsing the new ones.
+Return false if out of memory, the document is unchanged then.
+*/
+static bool spliceLines(asm_document* doc, size_t first, size_t removed, const char* text, size_t size){
+    size_t added = countTextLines(text, size);
+    size_t length = doc->length - removed + added;
+    if (length > doc->capacity){
+        size_t new_capacity = doc->capacity ? doc->capacity : 64;
+        while (new_capacity < length){
+            new_capacity *= 2;
+        }
+        doc_line* new_lines = realloc(doc->lines, new_capacity * sizeof(doc_line));
+        if (new_lines == NULL){
+            return false;
+        }
+        stats_count_alloc(1);
+        doc->lines = new_lines;
+        doc->capacity = new_capacity;
+    }
+    text_block* block = NULL;
+    if (added > 0){
+        // every line gets its newline, so each parses exactly as it would in a file
+        block = malloc(sizeof(text_block) + size + 1);
+        if (block == NULL){
+            return false;
+        }
+        stats_count_alloc(1);
+        block->refs = added;
+        memcpy(block->data, text, size);
+        block->data[size] = '\n';
+    }
+
+    for (size_t i = first; i < first + removed; ++i){
+        releaseLine(&doc->lines[i]);
+    }
+    memmove(doc->lines + first + added, doc->lines + first + removed,
+        (doc->length - first - removed) * sizeof(doc_line));
+    doc->length = length;
+
+    source input;
+    openBuffer(&input, block != NULL ? block->data : "", block != NULL ? size + 1 : 0);
+    for (size_t i = first; i < first + added; ++i){
+        doc_line* line = &doc->lines[i];
+        memset(line, 0, sizeof(doc_line));
+        line->block = block;
+        line->text = input.data + input.pos;
+        line->lret = readAndParse(&input, &line->label, &line->op, &line->args[0], &line->args[1],
+            &line->args[2], &line->args[3], &line->opcode);
+        line->length = (size_t)(input.data + input.pos - line->text) - 1;
+        if (line->lret == OK){
+            diag_list scratch;
+            diag_init(&scratch);
+            line->increment = add_label_increment(line->opcode, line->args[0], &scratch);
+            line->bad = diag_failed(&scratch);
+            diag_free(&scratch);
+        }
+    }
+    return true;
+}
+
+// Encode a line at location into its own words, return false on an error
+static bool encodeLine(asm_document* doc, doc_line* line, int location, diag_list* diags){
+    image* words = doc->scratch;
+    image_clear(words);
+    int offset = 0;
+    int word = selectOpFunc(line->opcode, line->op, line->args[0], line->args[1], line->args[2], line->args[3],
+        words, doc->ws->table, NULL, &offset, location, diags);
+    if (word != NO_WORD){
+        emitWord(words, diags, word);
+    }
+    if (diag_failed(diags)){
+        return false;
+    }
+
+    free(line->words);
+    line->words = NULL;
+    line->count = image_size(words);
+    if (words->zeros > 0){
+        // a .blkw kept as a region, its words are all zero and aren't stored
+    } else if (words->length == 1){
+        line->word = words->words[0];
+    } else if (words->length > 1){
+        line->words = malloc(words->length * sizeof(uint16_t));
+        if (line->words == NULL){
+            return diag_report(diags, 4, "Out of memory, terminating...");
+        }
+        stats_count_alloc(1);
+        memcpy(line->words, words->words, words->length * sizeof(uint16_t));
+    }
+    line->encoded = true;
+    return true;
+}
+
+/*
+Bring the label table and encodings up to date and write the image into output.
+Return false on any error without reporting it, the caller reassembles the whole
+text to get exactly the errors a full build would give.
+*/
+static bool updateDocument(asm_document* doc, image* output){
+    diag_list diags;
+    diag_init(&diags);
+    doc_line* lines = doc->lines;
+    bool ok = true;
+
+    // same as findOrig, lines before .orig are skipped
+    size_t origLine = 0;
+    while (origLine < doc->length && (lines[origLine].lret != OK || lines[origLine].opcode != ORIG)){
+        origLine++;
+    }
+    if (origLine == doc->length){
+        return false;
+    }
+    int orig = toNum(lines[origLine].args[0], &diags);
+    if (diag_failed(&diags)){
+        diag_free(&diags);
+        return false;
+    }
+
+    // same as firstPass, every label after .orig, even past .end
+    arena_reset(doc->ws->symbols);
+    symtab_clear(doc->ws->table);
+    int address = 0;
+    for (size_t i = origLine + 1; ok && i < doc->length; ++i){
+        doc_line* line = &lines[i];
+        if (line->lret != OK){
+            continue;
+        }
+        if (line->bad){
+            ok = false;
+            break;
+        }
+        if (line->label.len > 0){
+            if (!checkLabel(line->label, &diags) || symtab_add(doc->ws->table, line->label.ptr, line->label.len, orig + address) != SYM_ADDED){
+                ok = false;
+                break;
+            }
+        }
+        address += line->increment;
+    }
+
+    // same as secondPass, only new lines and moved PC-relative ones are encoded again
+    int offset = 0;
+    for (size_t i = origLine + 1; ok && i < doc->length; ++i){
+        doc_line* line = &lines[i];
+        offset += 2;
+        if (line->lret != OK){
+            continue;
+        }
+        int location = orig + offset;
+        int delta = 0;
+        token* pLabelRef = labelOperand(line->opcode, &line->args[0], &line->args[1]);
+        if (pLabelRef != NULL){
+            uint16_t target;
+            if (!symtab_get(doc->ws->table, pLabelRef->ptr, pLabelRef->len, &target)){
+                ok = false;
+                break;
+            }
+            delta = (int16_t)target - location;
+        }
+        if ((!line->encoded || delta != line->delta) && !encodeLine(doc, line, location, &diags)){
+            ok = false;
+            break;
+        }
+        line->delta = delta;
+        if (line->opcode == BLKW || line->opcode == STRINGZ){
+            offset += 2 * (int)line->count;
+        }
+        if (line->opcode == END){
+            break;
+        }
+    }
+    ok = ok && !diag_failed(&diags);
+    diag_free(&diags);
+    if (!ok){
+        return false;
+    }
+
+    image_clear(output);
+    output->orig = orig;
+    for (size_t i = origLine + 1; i < doc->length; ++i){
+        doc_line* line = &lines[i];
+        if (line->lret != OK){
+            continue;
+        }
+        if (line->count > 1 && line->words == NULL){
+            if (!image_fill(output, line->count)){
+                return false;
+            }
+        } else if (line->count == 1 ? !image_push(output, line->word)
+            : !image_reserve(output, line->count)){
+            return false;
+        } else if (line->count > 1){
+            memcpy(output->words + output->length, line->words, line->count * sizeof(uint16_t));
+            output->length += line->count;
+        }
+        if (line->opcode == END){
+            break;
+        }
+    }
+    return true;
+}
+
+// Join the lines of the document back into text, return NULL if out of memory
+static char* documentText(asm_document* doc, size_t* size){
+    size_t total = 0;
+    for (size_t i = 0; i < doc->length; ++i){
+        total += doc->lines[i].length + 1;
+    }
+    char* text = malloc(total > 0 ? total : 1);
+    if (text == NULL){
+        return NULL;
+    }
+    stats_count_alloc(1);
+    char* pOut = text;
+    for (size_t i = 0; i < doc->length; ++i){
+        size_t length = doc->lines[i].length + 1;
+        memcpy(pOut, doc->lines[i].text, length);
+        pOut += length;
+    }
+    *size = total;
+    return text;
+}
+
+bool asm_document_edit(asm_document* doc, size_t first, size_t removed, const char* text, size_t size,
+image* output, diag_list* diags){
+    if (first > doc->length || removed > doc->length - first){
+        return diag_report(diags, 4, "Edit outside of the document, terminating...");
+    }
+    if (!spliceLines(doc, first, removed, text, size)){
+        return diag_report(diags, 4, "Out of memory, terminating...");
+    }
+    if (updateDocument(doc, output)){
+        return true;
+    }
+
+    // something is wrong, a full build reports it exactly as it would for the file
+    size_t length;
+    char* joined = documentText(doc, &length);
+    if (joined == NULL){
+        return diag_report(diags, 4, "Out of memory, terminating...");
+    }
+    source input;
+    openBuffer(&input, joined, length);
+    image_clear(output);
+    bool ok = assembleWith(doc->ws, &input, &doc->options, output, diags);
+    free(joined);
+    return ok;
+}
+
+/*
+This selects the form of the opcode we are working on from the ISA tables and
+encodes it, pseudo ops are handled here. line is the IR of the instruction, NULL
+if it wasn't lexed into one. Returns NO_WORD for pseudo ops that write to the
+image themselves.
+*/
+static int selectOpFunc(int opcode, token opCode, token pArg1,token pArg2, token pArg3, token pArg4,
+image* output, symtab* table, const ir_line* line, int* offset, int location, diag_list* diags){
+    const isa_form* form = isa_form_of(opcode);
+    if (form != NULL){
+        token args[4] = {pArg1, pArg2, pArg3, pArg4};
+        return encodeForm(form, args, line, table, location, diags);
+    }
+
+    char lower[DIAG_MESSAGE_LENGTH];
+    switch(opcode){
+        case FILL: return fill(pArg1, diags);
+            break;
+        case BLKW: blkw(pArg1, output, offset, diags);
+                    return NO_WORD;
+            break;
+        case STRINGZ: stringz(pArg1, output, offset, diags);
+                    return NO_WORD;
+            break;
+        case END: return NO_WORD;
+            break;
+        case NUM_OPCODES: diag_report(diags, 2, "invalid opcode %s, terminating,,,", lowerToken(opCode, lower, sizeof(lower)));
+                        return NO_WORD;
+            break;
+        default: diag_report(diags, 2, "invalid opcode %s, terminating...", lowerToken(opCode, lower, sizeof(lower)));
+                return NO_WORD;
+            break;
+    }
+}
+
+/*
+This function checks if a register argument is formatted properly. If not we report
+an error as this is an ill formed input file
+*/
+static bool checkRegValid(token pArg, diag_list* diags){
+    char lower[DIAG_MESSAGE_LENGTH];
+    if (tokenAt(pArg, 0) != 'r'){
+        return diag_report(diags, 3, "Invalid Register Argument %s, must be in the format 'r1', terminating...", lowerToken(pArg, lower, sizeof(lower)));
+    }
+    if (!isdigit((unsigned char)tokenAt(pArg, 1))){
+        return diag_report(diags, 2, "Invalid Register Argument %s, no digit in argument, terminating...", lowerToken(pArg, lower, sizeof(lower)));
+    }
+    if(tokenAt(pArg, 1) - '0' > 7){
+        return diag_report(diags, 4, "Invalid Register Argumnet %s, digit must be less than 8, terminating...", lowerToken(pArg, lower, sizeof(lower)));
+    }
+    return true;
+}
+
+/*
+ this function checks if a constant is within the correct range.
+ Say that assembly instruction can have only an imm4 value but the
+ number 100 is input, then this is invalid and an error is reported
+ */
+static bool checkConstantValid(int constantValue, int maxValue, int minValue, diag_list* diags){
+if (constantValue > maxValue){
+    return diag_report(diags, 4, "Constant value greater than accepted %d, terminating...", constantValue);
+}
+if (constantValue < minValue){
+    return diag_report(diags, 4, "Constant value less than accepted %d, terminating...", constantValue);
+}
+return true;
+}
+
+/*
+The instruction encoder, every opcode that isn't a pseudo op is a form in the ISA
+tables. The operands are checked in the order the form lists them, then every
+field takes some bits of an operand and adds them to the base word. Registers,
+numbers and labels the IR line already has a value for are taken from it.
+*/
+static uint16_t encodeForm(const isa_form* form, const token args[4], const ir_line* line, symtab* table, int location,
+diag_list* diags){
+    if (form->select >= 0 && tokenAt(args[form->select], 0) == 'r'){ // register version
+        ++form;
+    }
+
+    int32_t values[4] = {0};
+    for (int i = 0; i < form->operand_count; ++i){
+        const isa_operand* operand = &form->operands[i];
+        int kind = line != NULL ? ir_kind(line, i) : OPERAND_NONE;
+        switch (operand->kind){
+            case ISA_REGISTER:
+                if (kind != OPERAND_REGISTER){
+                    checkRegValid(args[i], diags);
+                }
+                values[i] = tokenAt(args[i], 1) - '0';
+                continue;
+            case ISA_RAW_REGISTER:
+                values[i] = tokenAt(args[i], 1) - '0';
+                continue;
+            case ISA_NUMBER:
+                values[i] = kind == OPERAND_NUMBER ? line->args[i].value : toNum(args[i], diags);
+                break;
+            default: {
+                uint16_t labelVal;
+                int32_t labelId = kind == OPERAND_LABEL ? line->args[i].value : IR_NO_LABEL;
+                if (!findLabel(table, args[i], labelId, &labelVal)){
+                    char lower[DIAG_MESSAGE_LENGTH];
+                    diag_report(diags, 3, "Label %s not found, terminating...", lowerToken(args[i], lower, sizeof(lower)));
+                    return 0;
+                }
+                values[i] = ((int16_t)labelVal - location) / 2;
+                break;
+            }
+        }
+        values[i] = isa_truncate(operand, values[i]);
+        checkConstantValid(values[i], operand->max, operand->min, diags);
+    }
+
+    uint16_t word = form->base;
+    for (int i = 0; i < form->field_count; ++i){
+        const isa_field* field = &form->fields[i];
+        uint32_t bits = ((uint32_t)values[field->operand] >> field->shift) + field->bias;
+        word += (uint16_t)((bits & ((1u << field->width) - 1)) << field->pos);
+    }
+return word;
+}
+/*
+The block word pseudo op function. This function handles the pseudo opcode .blkw.
+*/
+static void blkw(token pArg1, image* output, int* pOffset, diag_list* diags){
+uint16_t numWords = toNum(pArg1, diags);
+
+/* big blocks are kept as a run of zeros, not stored word by word */
+if (!image_fill(output, numWords)){
+    diag_report(diags, 4, "Out of memory, terminating...");
+    return;
+}
+*pOffset += 2 * numWords;
+}
+
+/**
+ *The fill pseudo op function. This function handles the pseudo opcode .fill
+ * 
+ */
+static uint16_t fill(token pArg1, diag_list* diags){
+return (uint16_t)toNum(pArg1, diags);
+}
+
+/*
+The stringz pseudo op function. This function handles the pseudo opcode .stringz
+Two characters are packed per word, the first one in the low byte.
+*/
+static void stringz(token pArg1, image* output, int* pOffset, diag_list* diags){
+    size_t itr = 0;
+
+    while (itr < pArg1.len){
+        uint16_t word = (unsigned char)pArg1.ptr[itr];
+        ++itr;
+        if (itr < pArg1.len){
+            word |= (uint16_t)((unsigned char)pArg1.ptr[itr]) << 8;
+            ++itr;
+        }
+        if (!emitWord(output, diags, word)){
+            return;
+        }
+        *pOffset += 2;
+        }
+}
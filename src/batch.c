@@ -0,0 +1,380 @@
+#include "batch.h"
+#include "threadpool.h"
+#include <time.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+#endif
+
+// Paths of the inputs, in the order they were given
+typedef struct {
+    char** items;
+    size_t length;
+    size_t capacity;
+} path_list;
+
+// Outcome of assembling one input
+typedef struct {
+    int code;        // 0 on success, else the exit code of the first error
+    int line;        // line of the first error
+    size_t lines;    // lines read
+    size_t bytes;    // size of the source
+    char message[DIAG_MESSAGE_LENGTH];
+} batch_result;
+
+// Shared state of the batch tasks
+typedef struct {
+    const path_list* inputs;
+    asm_options options;
+    const char* outDir;
+    batch_result* results;
+    asm_workspace** workspaces; // one per thread, created on first use
+    image** images;             // one per thread, created on first use
+    asm_stats* stats;           // one per thread, NULL if not collecting stats
+} batch_job;
+
+// Append a copy of the first length characters of path, return false if out of memory
+static bool addPath(path_list* list, const char* path, size_t length){
+    if (list->length == list->capacity){
+        size_t new_capacity = list->capacity ? list->capacity * 2 : 64;
+        char** new_items = realloc(list->items, new_capacity * sizeof(char*));
+        if (new_items == NULL){
+            return false;
+        }
+        list->items = new_items;
+        list->capacity = new_capacity;
+    }
+    char* copy = malloc(length + 1);
+    if (copy == NULL){
+        return false;
+    }
+    memcpy(copy, path, length);
+    copy[length] = '\0';
+    list->items[list->length++] = copy;
+    return true;
+}
+
+static void freePaths(path_list* list){
+    for (size_t i = 0; i < list->length; ++i){
+        free(list->items[i]);
+    }
+    free(list->items);
+}
+
+// Return true if path ends with the given suffix
+static bool endsWith(const char* path, const char* suffix){
+    size_t length = strlen(path), suffixLength = strlen(suffix);
+    return length >= suffixLength && strcmp(path + length - suffixLength, suffix) == 0;
+}
+
+/*
+Add every input listed in a response file, one per line. Blank lines and lines
+starting with # are skipped.
+*/
+static bool addResponseFile(path_list* list, const char* path){
+    source file;
+    if (!openSource(&file, path)){
+        printf("Cannot find response file %s\n", path);
+        return false;
+    }
+    bool ok = true;
+    const char* lPtr = file.data;
+    const char* lEnd = file.data + file.size;
+    while (ok && lPtr < lEnd){
+        const char* lNewline = memchr(lPtr, '\n', lEnd - lPtr);
+        const char* lLineEnd = lNewline != NULL ? lNewline : lEnd;
+        const char* lStart = lPtr;
+        lPtr = lLineEnd + 1;
+
+        while (lStart < lLineEnd && (*lStart == ' ' || *lStart == '\t')){
+            lStart++;
+        }
+        while (lLineEnd > lStart && (lLineEnd[-1] == ' ' || lLineEnd[-1] == '\t' || lLineEnd[-1] == '\r')){
+            lLineEnd--;
+        }
+        if (lStart < lLineEnd && *lStart != '#'){
+            ok = addPath(list, lStart, lLineEnd - lStart);
+        }
+    }
+    closeSource(&file);
+    return ok;
+}
+
+#ifndef _WIN32
+// Add every .asm file in the directory, in name order
+static bool addDirectory(path_list* list, const char* path){
+    struct dirent** entries;
+    int count = scandir(path, &entries, NULL, alphasort);
+    if (count < 0){
+        printf("Cannot read directory %s\n", path);
+        return false;
+    }
+    bool ok = true;
+    size_t pathLength = strlen(path);
+    for (int i = 0; i < count; ++i){
+        const char* name = entries[i]->d_name;
+        if (ok && name[0] != '.' && endsWith(name, ".asm")){
+            size_t nameLength = strlen(name);
+            char* full = malloc(pathLength + nameLength + 2);
+            if (full == NULL){
+                ok = false;
+            } else {
+                memcpy(full, path, pathLength);
+                full[pathLength] = '/';
+                memcpy(full + pathLength + 1, name, nameLength + 1);
+                ok = addPath(list, full, pathLength + nameLength + 1);
+                free(full);
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return ok;
+}
+
+// Add every file matching a wildcard pattern, for when the shell didn't expand it
+static bool addPattern(path_list* list, const char* pattern){
+    glob_t matches;
+    int ret = glob(pattern, 0, NULL, &matches);
+    if (ret == GLOB_NOMATCH){
+        printf("No inputs match %s\n", pattern);
+        return false;
+    }
+    bool ok = ret == 0;
+    for (size_t i = 0; ok && i < matches.gl_pathc; ++i){
+        ok = addPath(list, matches.gl_pathv[i], strlen(matches.gl_pathv[i]));
+    }
+    globfree(&matches);
+    return ok;
+}
+#endif
+
+// Turn the command line arguments into the list of inputs, return false on error
+static bool collectInputs(path_list* list, char** args, int count){
+    for (int i = 0; i < count; ++i){
+        const char* arg = args[i];
+        bool ok;
+        if (arg[0] == '@'){
+            ok = addResponseFile(list, arg + 1);
+#ifndef _WIN32
+        } else if (strpbrk(arg, "*?[") != NULL){
+            ok = addPattern(list, arg);
+        } else {
+            struct stat st;
+            if (stat(arg, &st) == 0 && S_ISDIR(st.st_mode)){
+                ok = addDirectory(list, arg);
+            } else {
+                ok = addPath(list, arg, strlen(arg));
+            }
+#else
+        } else {
+            ok = addPath(list, arg, strlen(arg));
+#endif
+        }
+        if (!ok){
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+Return the output path for an input: its extension is replaced with the one of the
+format and it moves into outDir if given. Return NULL if out of memory.
+*/
+static char* outputPath(const char* input, const char* outDir, int format){
+    const char* name = input;
+    if (outDir != NULL){
+        for (const char* p = input; *p != '\0'; ++p){
+            if (*p == '/' || *p == '\\'){
+                name = p + 1;
+            }
+        }
+    }
+    size_t stemLength = strlen(name);
+    for (size_t i = stemLength; i > 0; --i){
+        if (name[i - 1] == '/' || name[i - 1] == '\\'){
+            break;
+        }
+        if (name[i - 1] == '.'){
+            stemLength = i - 1;
+            break;
+        }
+    }
+
+    const char* extension = formatExtension(format);
+    size_t dirLength = outDir != NULL ? strlen(outDir) : 0;
+    char* path = malloc(dirLength + 1 + stemLength + strlen(extension) + 1);
+    if (path == NULL){
+        return NULL;
+    }
+    char* pOut = path;
+    if (outDir != NULL){
+        memcpy(pOut, outDir, dirLength);
+        pOut += dirLength;
+        *pOut++ = '/';
+    }
+    memcpy(pOut, name, stemLength);
+    strcpy(pOut + stemLength, extension);
+    return path;
+}
+
+// Record the first error of a failed input
+static void setError(batch_result* result, int code, int line, const char* message){
+    result->code = code;
+    result->line = line;
+    snprintf(result->message, DIAG_MESSAGE_LENGTH, "%s", message);
+}
+
+// Assemble a single input and write its output
+static void assembleOne(batch_job* job, size_t index, int thread){
+    const char* path = job->inputs->items[index];
+    batch_result* result = &job->results[index];
+
+    // each is retried on its own if creating it failed last time
+    if (job->workspaces[thread] == NULL){
+        job->workspaces[thread] = asm_workspace_create();
+    }
+    if (job->images[thread] == NULL){
+        job->images[thread] = image_create();
+    }
+    asm_workspace* ws = job->workspaces[thread];
+    image* img = job->images[thread];
+    if (ws == NULL || img == NULL){
+        setError(result, 4, 0, "Out of memory, terminating...");
+        return;
+    }
+
+    source input;
+    if (!openSource(&input, path)){
+        setError(result, 4, 0, "Cannot open input file");
+        return;
+    }
+    diag_list diags;
+    diag_init(&diags);
+    image_clear(img);
+    asm_options options = job->options;
+    options.stats = job->stats != NULL ? &job->stats[thread] : NULL;
+    assembleWith(ws, &input, &options, img, &diags);
+    result->lines = countLines(&input);
+    result->bytes = input.size;
+    closeSource(&input);
+
+    if (diag_failed(&diags)){
+        if (diags.length > 0){
+            setError(result, diags.items[0].code, diags.items[0].line, diags.items[0].message);
+        } else {
+            setError(result, 4, 0, "Out of memory, terminating...");
+        }
+        diag_free(&diags);
+        return;
+    }
+
+    char* outPath = outputPath(path, job->outDir, job->options.format);
+    FILE* output = outPath != NULL ? fopen(outPath, isBinaryFormat(job->options.format) ? "wb" : "w") : NULL;
+    if (output == NULL){
+        setError(result, 4, 0, "Cannot create output file");
+    } else {
+        double start = options.stats != NULL ? stats_now() : 0;
+        if (!writeImage(img, output, job->options.format)){
+            setError(result, 4, 0, "Could not write output file");
+        }
+        if (options.stats != NULL){
+            options.stats->seconds[PHASE_OUTPUT] += stats_now() - start;
+            options.stats->lines[PHASE_OUTPUT] += image_size(img);
+            options.stats->bytes[PHASE_OUTPUT] += (size_t)ftell(output);
+        }
+        fclose(output);
+    }
+    free(outPath);
+}
+
+// The task run by the pool, allocations are counted along with the stats of the thread
+static void assembleInput(void* arg, size_t index, int thread){
+    batch_job* job = arg;
+    size_t* outer = stats_count_into(job->stats != NULL ? &job->stats[thread].allocations : NULL);
+    assembleOne(job, index, thread);
+    stats_count_into(outer);
+}
+
+int runBatch(char** args, int count, const asm_options* options, const char* outDir){
+    path_list inputs = {NULL, 0, 0};
+    if (!collectInputs(&inputs, args, count)){
+        freePaths(&inputs);
+        return 1;
+    }
+
+    batch_job job;
+    job.inputs = &inputs;
+    job.options = *options;
+    job.options.threads = 1; // the inputs are what runs in parallel
+    job.outDir = outDir;
+    job.results = calloc(inputs.length > 0 ? inputs.length : 1, sizeof(batch_result));
+
+    int threads = options->threads > 0 ? options->threads : cpu_count();
+    threadpool* pool = (threads > 1 && inputs.length > 1) ? pool_create(threads) : NULL;
+    int size = pool_size(pool);
+    job.workspaces = calloc(size, sizeof(asm_workspace*));
+    job.images = calloc(size, sizeof(image*));
+    job.stats = options->stats != NULL ? calloc(size, sizeof(asm_stats)) : NULL;
+    if (job.results == NULL || job.workspaces == NULL || job.images == NULL
+        || (options->stats != NULL && job.stats == NULL)){
+        printf("Out of memory, terminating...\n");
+        pool_destroy(pool);
+        free(job.results);
+        free(job.workspaces);
+        free(job.images);
+        free(job.stats);
+        freePaths(&inputs);
+        return 4;
+    }
+
+    double start = stats_now();
+    pool_run(pool, assembleInput, &job, inputs.length);
+    double elapsed = stats_now() - start;
+    pool_destroy(pool);
+
+    if (job.stats != NULL){
+        for (int i = 0; i < size; ++i){
+            stats_add(options->stats, &job.stats[i]);
+        }
+    }
+
+    size_t failed = 0, lines = 0, bytes = 0;
+    for (size_t i = 0; i < inputs.length; ++i){
+        batch_result* result = &job.results[i];
+        lines += result->lines;
+        bytes += result->bytes;
+        if (result->code != 0){
+            failed++;
+            if (result->line > 0){
+                printf("%s:%d: %s\n", inputs.items[i], result->line, result->message);
+            } else {
+                printf("%s: %s\n", inputs.items[i], result->message);
+            }
+        }
+    }
+
+    double seconds = elapsed > 0 ? elapsed : 1e-9;
+    printf("Assembled %zu files (%zu failed) on %d thread%s in %.3f s\n", inputs.length, failed, size,
+        size == 1 ? "" : "s", elapsed);
+    printf("%zu lines, %.2f MB: %.0f lines/s, %.2f MB/s, %.0f files/s\n", lines, bytes / 1e6,
+        lines / seconds, bytes / 1e6 / seconds, inputs.length / seconds);
+
+    for (int i = 0; i < size; ++i){
+        if (job.workspaces[i] != NULL){
+            asm_workspace_destroy(job.workspaces[i]);
+        }
+        if (job.images[i] != NULL){
+            image_destroy(job.images[i]);
+        }
+    }
+    free(job.workspaces);
+    free(job.images);
+    free(job.stats);
+    free(job.results);
+    freePaths(&inputs);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+#include "cache.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define makeDir(path) _mkdir(path)
+#define processId() _getpid()
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define makeDir(path) mkdir(path, 0777)
+#define processId() getpid()
+#endif
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define MAX_PATH_LENGTH 4096
+
+// Header at the start of every cache file, the words follow it and then the regions
+typedef struct {
+    char magic[4];       // "AHC2"
+    uint16_t orig;       // origin of the image
+    uint64_t hi, lo;     // key, checked so a renamed or corrupt file is never used
+    uint64_t sourceSize; // bytes of source, a cheap second check on the key
+    uint64_t length;     // number of stored words
+    uint64_t regions;    // number of regions, their at counted from the first stored word
+} cache_header;
+
+static const char magic[4] = {'A', 'H', 'C', '2'};
+
+// Counts temporary files so threads of one process never pick the same name
+static atomic_uint tempCounter;
+
+static uint64_t rotl(uint64_t x, int r){
+    return (x << r) | (x >> (64 - r));
+}
+
+// Final avalanche so every input bit affects every output bit
+static uint64_t mix(uint64_t h){
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Feed size bytes into both halves of the key, eight bytes at a time
+static void absorb(cache_key* key, const char* data, size_t size){
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8){
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        key->hi = rotl(key->hi ^ (word * PRIME2), 31) * PRIME1;
+        key->lo = rotl(key->lo + (word * PRIME1), 27) * PRIME2 + key->hi;
+    }
+    uint64_t tail = size;
+    for (; i < size; ++i){
+        tail = (tail << 8) | (unsigned char)data[i];
+    }
+    key->hi = rotl(key->hi ^ (tail * PRIME2), 31) * PRIME1;
+    key->lo = rotl(key->lo + (tail * PRIME1), 27) * PRIME2 + key->hi;
+}
+
+cache_key cache_hash(const char* data, size_t size, const char* version){
+    cache_key key = {PRIME1, PRIME2};
+    absorb(&key, version, strlen(version));
+    absorb(&key, data, size);
+    key.hi = mix(key.hi ^ size);
+    key.lo = mix(key.lo ^ key.hi);
+    return key;
+}
+
+// Write the path of the entry for key into path, return false if it doesn't fit
+static bool entryPath(char* path, const char* dir, cache_key key){
+    int written = snprintf(path, MAX_PATH_LENGTH, "%s/%016llx%016llx.img", dir,
+        (unsigned long long)key.hi, (unsigned long long)key.lo);
+    return written > 0 && written < MAX_PATH_LENGTH;
+}
+
+bool cache_load(const char* dir, cache_key key, size_t sourceSize, image* output){
+    char path[MAX_PATH_LENGTH];
+    if (!entryPath(path, dir, key)){
+        return false;
+    }
+    FILE* file = fopen(path, "rb");
+    if (file == NULL){
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    cache_header header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, magic, sizeof(magic)) == 0
+        && header.hi == key.hi && header.lo == key.lo
+        && header.sourceSize == sourceSize
+        && (uint64_t)fileSize == sizeof(header) + header.length * sizeof(uint16_t)
+            + header.regions * sizeof(image_region)
+        && image_reserve(output, header.length)
+        && image_reserve_regions(output, header.regions)
+        && fread(output->words + output->length, sizeof(uint16_t), header.length, file) == header.length
+        && fread(output->regions + output->region_count, sizeof(image_region), header.regions, file) == header.regions;
+    fclose(file);
+
+    // regions out of order or past the words would make a corrupt image
+    size_t zeros = 0;
+    image_region* regions = output->regions + output->region_count;
+    for (uint64_t i = 0; ok && i < header.regions; ++i){
+        ok = regions[i].at <= header.length && (i == 0 || regions[i].at >= regions[i - 1].at);
+        regions[i].at += output->length;
+        zeros += regions[i].count;
+    }
+    if (ok){
+        output->orig = header.orig;
+        output->length += header.length;
+        output->region_count += header.regions;
+        output->zeros += zeros;
+    }
+    return ok;
+}
+
+bool cache_store(const char* dir, cache_key key, size_t sourceSize, const image* img, size_t first, size_t firstRegion){
+    char path[MAX_PATH_LENGTH], temp[MAX_PATH_LENGTH];
+    if (!entryPath(path, dir, key)){
+        return false;
+    }
+    int written = snprintf(temp, MAX_PATH_LENGTH, "%s.%d.%u.tmp", path, (int)processId(),
+        atomic_fetch_add(&tempCounter, 1));
+    if (written <= 0 || written >= MAX_PATH_LENGTH){
+        return false;
+    }
+
+    FILE* file = fopen(temp, "wb");
+    if (file == NULL && errno == ENOENT && makeDir(dir) == 0){
+        file = fopen(temp, "wb");
+    }
+    if (file == NULL){
+        return false;
+    }
+    cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.orig = img->orig;
+    header.hi = key.hi;
+    header.lo = key.lo;
+    header.sourceSize = sourceSize;
+    header.length = img->length - first;
+    header.regions = img->region_count - firstRegion;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(img->words + first, sizeof(uint16_t), header.length, file) == header.length;
+    for (size_t i = firstRegion; ok && i < img->region_count; ++i){
+        image_region region = {img->regions[i].at - first, img->regions[i].count};
+        ok = fwrite(&region, sizeof(region), 1, file) == 1;
+    }
+    ok = fclose(file) == 0 && ok;
+
+    // the rename is what makes the entry visible, readers never see half a file
+    if (!ok || rename(temp, path) != 0){
+        remove(temp);
+        return false;
+    }
+    return true;
+}
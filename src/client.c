@@ -0,0 +1,121 @@
+#include "server.h"
+
+/*
+Thin client for the assembler server: sends one source to a running "assembler --serve"
+and writes the image it gets back, or prints the first error and exits with its code
+just like the assembler does.
+
+    asmclient [--socket=PATH] [--single-pass] [--format=hex|bin|obj|sobj] input [output]
+    asmclient [--socket=PATH] --stop
+
+The image goes to stdout when no output is given.
+*/
+
+static void usage(void){
+    printf("Usage: asmclient [--socket=PATH] [--single-pass] [--format=hex|bin|obj|sobj] input [output]\n");
+    printf("       asmclient [--socket=PATH] --stop\n");
+}
+
+int main(int argc, char** argv){
+    char path[SERVER_PATH_LENGTH];
+    defaultSocketPath(path, sizeof(path));
+    const char* inputFile = NULL;
+    const char* outputFile = NULL;
+    int passMode = TWO_PASS;
+    int format = FORMAT_HEX;
+    bool stop = false;
+
+    for (int i = 1; i < argc; ++i){
+        if (strncmp(argv[i], "--socket=", 9) == 0){
+            snprintf(path, sizeof(path), "%s", argv[i] + 9);
+        } else if (strcmp(argv[i], "--single-pass") == 0){
+            passMode = SINGLE_PASS;
+        } else if (strncmp(argv[i], "--format=", 9) == 0){
+            format = findFormat(argv[i] + 9);
+            if (format < 0){
+                printf("Unknown output format %s, expected hex, bin, obj or sobj\n", argv[i] + 9);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stop") == 0){
+            stop = true;
+        } else if (strncmp(argv[i], "--", 2) == 0){
+            usage();
+            return 1;
+        } else if (inputFile == NULL){
+            inputFile = argv[i];
+        } else if (outputFile == NULL){
+            outputFile = argv[i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (!stop && inputFile == NULL){
+        usage();
+        return 1;
+    }
+
+    int fd = connectServer(path);
+    if (fd < 0){
+        printf("No assembler server on %s, start one with assembler --serve\n", path);
+        return 1;
+    }
+    if (stop){
+        bool ok = stopServer(fd);
+        disconnectServer(fd);
+        return ok ? 0 : 1;
+    }
+
+    source input;
+    if (!openSource(&input, inputFile)){
+        printf("Cannot find file name %s, terminating...", inputFile);
+        disconnectServer(fd);
+        return 4;
+    }
+    diag_list diags;
+    diag_init(&diags);
+    image* img = image_create();
+    if (img == NULL){
+        diag_report(&diags, 4, "Out of memory, terminating...");
+    } else {
+        remoteAssemble(fd, input.data, input.size, passMode, img, &diags);
+    }
+    closeSource(&input);
+    disconnectServer(fd);
+
+    if (diag_failed(&diags)){
+        int code = 4;
+        if (diags.length > 0){
+            code = diags.items[0].code;
+            if (diags.items[0].line > 0){
+                printf("%s:%d: %s\n", inputFile, diags.items[0].line, diags.items[0].message);
+            } else {
+                printf("%s: %s\n", inputFile, diags.items[0].message);
+            }
+        } else {
+            printf("Out of memory, terminating...");
+        }
+        diag_free(&diags);
+        if (img != NULL){
+            image_destroy(img);
+        }
+        return code;
+    }
+
+    FILE* output = outputFile != NULL ? fopen(outputFile, isBinaryFormat(format) ? "wb" : "w") : stdout;
+    if (output == NULL){
+        printf("Cannot create output file %s, terminating...", outputFile);
+        image_destroy(img);
+        return 4;
+    }
+    bool ok = writeImage(img, output, format);
+    if (output != stdout){
+        ok = fclose(output) == 0 && ok;
+    }
+    image_destroy(img);
+    if (!ok){
+        printf("Could not write output file %s, terminating...", outputFile != NULL ? outputFile : "stdout");
+        return 4;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "diag.h"
+#include "stats.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void diag_init(diag_list* list){
+    list->items = NULL;
+    list->length = 0;
+    list->capacity = 0;
+    list->errors = 0;
+    list->line = 0;
+}
+
+void diag_free(diag_list* list){
+    free(list->items);
+    diag_init(list);
+}
+
+// Make room for extra diagnostics, return false if out of memory
+static bool diag_reserve(diag_list* list, size_t extra){
+    if (list->length + extra <= list->capacity){
+        return true;
+    }
+    size_t new_capacity = list->capacity ? list->capacity * 2 : 4;
+    while (new_capacity < list->length + extra){
+        new_capacity *= 2;
+    }
+    diagnostic* new_items = realloc(list->items, new_capacity * sizeof(diagnostic));
+    if (new_items == NULL){
+        return false;
+    }
+    stats_count_alloc(1);
+    list->items = new_items;
+    list->capacity = new_capacity;
+    return true;
+}
+
+bool diag_report(diag_list* list, int code, const char* format, ...){
+    list->errors++;
+    if (!diag_reserve(list, 1)){
+        return false;
+    }
+
+    diagnostic* diag = &list->items[list->length++];
+    diag->code = code;
+    diag->line = list->line;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(diag->message, DIAG_MESSAGE_LENGTH, format, args);
+    va_end(args);
+    return false;
+}
+
+void diag_append(diag_list* dst, diag_list* src){
+    dst->errors += src->errors;
+    if (src->length > 0 && diag_reserve(dst, src->length)){
+        memcpy(dst->items + dst->length, src->items, src->length * sizeof(diagnostic));
+        dst->length += src->length;
+    }
+    diag_free(src);
+}
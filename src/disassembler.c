@@ -0,0 +1,171 @@
+#include "isa.h"
+#include "output.h"
+
+/*
+Disassembler: lists an image written by the assembler as one instruction per word,
+decoded with the same tables the assembler encodes with.
+
+    disassembler [--format=hex|bin|obj|sobj] [--orig=ADDRESS] input
+
+A raw binary has no origin in it, --orig gives one (default 0). Words that some
+forms share, like ret and jmp r7, come out as the form with the most fixed bits,
+and data words as whatever instruction they happen to look like.
+*/
+
+static void usage(void){
+    printf("Usage: disassembler [--format=hex|bin|obj|sobj] [--orig=ADDRESS] input\n");
+}
+
+static int hexDigit(char c){
+    if (c >= '0' && c <= '9'){
+        return c - '0';
+    }
+    c = LOWER(c);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+/*
+Read the words of a sparse object into words, its origin first like an obj, and
+return the count or -1 if malformed. With words NULL only counts them.
+*/
+static long readSparse(const source* input, uint16_t* words){
+    const unsigned char* bytes = (const unsigned char*)input->data;
+    size_t size = input->size / 2 * 2;
+    if (size != input->size || size == 0){
+        return -1;
+    }
+    long count = 0;
+    if (words != NULL){
+        words[count] = (uint16_t)(bytes[0] << 8 | bytes[1]);
+    }
+    count++;
+    for (size_t pos = 2; pos < size;){
+        uint16_t header = (uint16_t)(bytes[pos] << 8 | bytes[pos + 1]);
+        size_t run = header & 0x7FFF;
+        pos += 2;
+        if (header & 0x8000){
+            if (words != NULL){
+                memset(words + count, 0, run * sizeof(uint16_t));
+            }
+        } else {
+            if (run > (size - pos) / 2){
+                return -1;
+            }
+            for (size_t i = 0; words != NULL && i < run; ++i){
+                words[count + i] = (uint16_t)(bytes[pos + 2 * i] << 8 | bytes[pos + 2 * i + 1]);
+            }
+            pos += 2 * run;
+        }
+        count += (long)run;
+    }
+    return count;
+}
+
+// Read the "0xNNNN" lines of a hex image into words, return the count or -1 if malformed
+static long readHex(const source* input, uint16_t* words){
+    long count = 0;
+    size_t pos = 0;
+    while (pos < input->size){
+        const char* line = input->data + pos;
+        const char* newline = memchr(line, '\n', input->size - pos);
+        size_t length = newline != NULL ? (size_t)(newline - line) : input->size - pos;
+        pos += length + 1;
+        if (length > 0 && line[length - 1] == '\r'){
+            length--;
+        }
+        if (length == 0){
+            continue;
+        }
+        if (length < 3 || line[0] != '0' || LOWER(line[1]) != 'x' || length > 6){
+            return -1;
+        }
+        uint16_t word = 0;
+        for (size_t i = 2; i < length; ++i){
+            int digit = hexDigit(line[i]);
+            if (digit < 0){
+                return -1;
+            }
+            word = (uint16_t)(word << 4 | digit);
+        }
+        words[count++] = word;
+    }
+    return count;
+}
+
+int main(int argc, char** argv){
+    const char* inputFile = NULL;
+    int format = FORMAT_HEX;
+    long orig = 0;
+
+    for (int i = 1; i < argc; ++i){
+        if (strncmp(argv[i], "--format=", 9) == 0){
+            format = findFormat(argv[i] + 9);
+            if (format < 0){
+                printf("Unknown image format %s, expected hex, bin, obj or sobj\n", argv[i] + 9);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--orig=", 7) == 0){
+            orig = strtol(argv[i] + 7, NULL, 0);
+        } else if (strncmp(argv[i], "--", 2) == 0 || inputFile != NULL){
+            usage();
+            return 1;
+        } else {
+            inputFile = argv[i];
+        }
+    }
+    if (inputFile == NULL){
+        usage();
+        return 1;
+    }
+
+    source input;
+    if (!openSource(&input, inputFile)){
+        printf("Cannot find file name %s, terminating...", inputFile);
+        return 4;
+    }
+    // a hex line is at least four bytes with its newline, a binary word two, a sparse object is counted first
+    size_t capacity = input.size / 2;
+    long sparseCount = 0;
+    if (format == FORMAT_SOBJ){
+        sparseCount = readSparse(&input, NULL);
+        capacity = sparseCount > 0 ? (size_t)sparseCount : 0;
+    }
+    uint16_t* words = malloc((capacity + 1) * sizeof(uint16_t));
+    if (words == NULL){
+        closeSource(&input);
+        printf("Out of memory, terminating...");
+        return 4;
+    }
+    long count;
+    if (format == FORMAT_HEX){
+        count = readHex(&input, words);
+    } else if (format == FORMAT_SOBJ){
+        count = sparseCount < 0 ? -1 : readSparse(&input, words);
+    } else {
+        count = (long)(input.size / 2);
+        const unsigned char* bytes = (const unsigned char*)input.data;
+        for (long i = 0; i < count; ++i){
+            words[i] = (uint16_t)(bytes[2 * i] << 8 | bytes[2 * i + 1]);
+        }
+    }
+    closeSource(&input);
+    if (count < 0 || (format != FORMAT_BIN && count == 0)){
+        printf("%s is not a %s image, terminating...", inputFile, formatExtension(format) + 1);
+        free(words);
+        return 4;
+    }
+
+    long first = 0;
+    if (format != FORMAT_BIN){
+        orig = words[0];
+        first = 1;
+    }
+    char text[64];
+    for (long i = first; i < count; ++i){
+        int address = (int)((orig + 2 * (i - first)) & 0xFFFF);
+        isa_disassemble(words[i], address, text, sizeof(text));
+        printf("x%04x  %04x  %s\n", address, words[i], text);
+    }
+    free(words);
+    return 0;
+}
@@ -1,258 +1,443 @@
-#include "fileFunctions.h"
-#include <limits.h>
-
-#define MIN(x,y) ((x < y) ? (x) : (y))
-
-extern ht* label_table; 
-
-/*
-Basic funcion used to get the file path from the user, just prompts
-and waits for input 2 times. One for input file, one for ouput file.
- */
-void obtainFilePath(char* inputFile, char* outputFile, uint16_t maxSize){
-    printf("Enter the input file path:");
-    
-    if (fgets(inputFile, maxSize,stdin) != NULL){
-        size_t len = strlen(inputFile);
-        if (len > 0 && inputFile[len-1] == '\n'){
-            inputFile[len-1] = '\0';
-        }
-    }
-    printf("Enter the output file path:");
-    
-    if (fgets(outputFile, maxSize,stdin) != NULL){
-        size_t len = strlen(outputFile);
-        if (len > 0 && outputFile[len-1] == '\n'){
-            outputFile[len-1] = '\0';
-        }
-    }
-}
-
-/*
-Simply checks if the given is a valid opcode. if so return truw, otherwise return false
- */
-bool isOpcode(const char* inputString){
-    char *opCodes[NUM_OPCODES] = {"add", "and", "or", "xor", "ldb", "ldw", "ldi", "ldib", "lea",
-    "stb", "stw", "sti", "stib", "br", "brn", "brnz", "brnp", "brnzp", "brzp", "brz", "brp", "jmp",
-    "jsr", "jsrr", "ret", "rti", "mul", "div", "trap", "lshf", "rshfl", "rshfa", "mov", "rot",
-    "push", "pushb", "pop", "popb", "macc", "extdb", "extdw", "halt", ".fill", ".blkw", ".stringz", ".end", ".orig"};
-
-    for (int i = 0; i < NUM_OPCODES; i++){
-        if (strcmp(inputString, opCodes[i]) == 0){
-            return true;
-        }
-    }
-
-    return false;
-}
-
-/*
-simple function that checks which case the opcode was. Returns that index in the array.
- */
-int findOpcode(const char* inputString){
-  char *opCodes[NUM_OPCODES] = {"add", "and", "or", "xor", "ldb", "ldw", "ldi", "ldib", "lea",
-    "stb", "stw", "sti", "stib", "br", "brn", "brnz", "brnp", "brnzp", "brzp", "brz", "brp", "jmp",
-    "jsr", "jsrr", "ret", "rti", "mul", "div", "trap", "lshf", "rshfl", "rshfa", "mov", "rot",
-    "push", "pushb", "pop", "popb", "macc", "extdb", "extdw", "halt",".fill", ".blkw", ".stringz", ".end", ".orig"};
-  int i = 0;
-    for (i; i < NUM_OPCODES; ++i){
-        if (strcmp(inputString, opCodes[i]) == 0){
-            break;
-        }
-    }
-
-    return i;
-}
-
-/*
-Converts a user given string representing a number, either in format:
-#3 or x3 into an integer value. If formatted incorrectly terminates the 
-program
-*/
-int toNum( char* pStr )
-{
-   char * t_ptr;
-   char * orig_pStr;
-   int t_length,k;
-   int lNum, lNeg = 0;
-   long int lNumLong;
-
-   orig_pStr = pStr;
-   if (*pStr == '0'){
-    pStr++;
-   }
-   if( *pStr == '#' )				/* decimal */
-   { 
-     pStr++;
-     if( *pStr == '-' )				/* dec is negative */
-     {
-       lNeg = 1;
-       pStr++;
-     }
-     t_ptr = pStr;
-     t_length = strlen(t_ptr);
-     for(k=0;k < t_length;k++)
-     {
-       if (!isdigit(*t_ptr))
-       {
-	 printf("Error: invalid decimal operand, %s\n",orig_pStr);
-   ht_destroy(label_table);
-	 exit(4);
-       }
-       t_ptr++;
-     }
-     lNum = atoi(pStr);
-     if (lNeg)
-       lNum = -lNum;
- 
-     return lNum;
-   }
-   else if( *pStr == 'x' )	/* hex     */
-   {
-     pStr++;
-     if( *pStr == '-' )				/* hex is negative */
-     {
-       lNeg = 1;
-       pStr++;
-     }
-     t_ptr = pStr;
-     t_length = strlen(t_ptr);
-     for(k=0;k < t_length;k++)
-     {
-       if (!isxdigit(*t_ptr))
-       {
-	 printf("Error: invalid hex operand, %s\n",orig_pStr);
-   ht_destroy(label_table);
-	 exit(4);
-       }
-       t_ptr++;
-     }
-     lNumLong = strtol(pStr, NULL, 16);    /* convert hex string into integer */
-     lNum = (lNumLong > INT_MAX)? INT_MAX : lNumLong;
-     if( lNeg )
-       lNum = -lNum;
-     return lNum;
-   }
-   else
-   {
-	printf( "Error: invalid operand, %s\n", orig_pStr);
-  ht_destroy(label_table);
-	exit(4);  /* This has been changed from error code 3 to error code 4, see clarification 12 */
-   }
-}
-
-/*
-Function that reads a line of text from a file and 
-parses the line for the data held inside.
-*/
-int readAndParse( FILE* pInfile, char* pLine, char** pLabel, char
-	** pOpcode, char** pArg1, char** pArg2, char** pArg3, char** pArg4
-	)
-	{
-	  char * lRet, * lPtr;
-	  int i;
-	  if( !fgets( pLine, MAX_LINE_LENGTH, pInfile ) )
-	    return( DONE );
-    int line_length = strlen( pLine );
-	  for( i = 0; i < line_length; i++ ){
-      
-		  pLine[i] = tolower( pLine[i] );
-      if (pLine[i] == '.' && ((line_length - (i - 1)) > 7)){
-        ++i;
-        int j = i + 7;
-        for (i; i < j; ++i){
-          pLine[i] = tolower( pLine[i] );
-        }
-
-        char stringz_copy[9] = {0};
-        memcpy(stringz_copy, &pLine[j - 8], 8);
-        if (!strcmp(stringz_copy, ".stringz"))
-          break;
-      }
-    }
-	   
-           /* convert entire line to lowercase */
-	  *pLabel = *pOpcode = *pArg1 = *pArg2 = *pArg3 = *pArg4 = pLine + strlen(pLine);
-
-	  /* ignore the comments */
-	  lPtr = pLine;
-
-	  while( *lPtr != ';' && *lPtr != '\0' && *lPtr != '\n' ) 
-		  lPtr++;
-
-	  *lPtr = '\0';
-	  if( !(lPtr = strtok( pLine, "\t\n ," ) ) ) 
-		  return( EMPTY_LINE );
-
-	  if( isOpcode( lPtr ) == false && lPtr[0] != '.' ) /* found a label */
-	  {
-		  *pLabel = lPtr;
-		  if( !( lPtr = strtok( NULL, "\t\n ," ) ) ) return( OK );
-	  }
-	   
-           *pOpcode = lPtr;
-
-	   if( !( lPtr = strtok( NULL, "\t\n ," ) ) ) return( OK );
-	   
-           *pArg1 = lPtr;
-	   
-           if( !( lPtr = strtok( NULL, "\t\n ," ) ) ) return( OK );
-
-	   *pArg2 = lPtr;
-	   if( !( lPtr = strtok( NULL, "\t\n ," ) ) ) return( OK );
-
-	   *pArg3 = lPtr;
-
-	   if( !( lPtr = strtok( NULL, "\t\n ," ) ) ) return( OK );
-
-	   *pArg4 = lPtr;
-
-	   return( OK );
-	}
-
-
-/*
-Simple function that converts an integer into its hex
-character equivalent
-*/
-char toHexString(uint8_t input){
-
-  switch (input){
-    case 0: return '0';
-      break; 
-    case 1: return '1';
-      break;
-    case 2: return '2';
-      break;
-    case 3: return '3';
-      break;
-    case 4: return '4';
-      break;
-    case 5: return '5';
-      break;
-    case 6: return '6';
-      break;
-    case 7: return '7';
-      break;
-    case 8: return '8';
-      break;
-    case 9: return '9';
-      break;
-    case 10: return 'a';
-      break;
-    case 11: return 'b';
-      break;
-    case 12: return 'c';
-      break;
-    case 13: return 'd';
-      break;
-    case 14: return 'e';
-      break;
-    case 15: return 'f';
-      break;
-    default: return 'g';
-    break;
-  }
-
-  return '0';
-}
+#include "fileFunctions.h"
+#include "stats.h"
+#include "scan.h"
+#include <limits.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define MIN(x,y) ((x < y) ? (x) : (y))
+
+// Opcode names, indexed by the opcode enum
+static const char* const opCodes[NUM_OPCODES] = {"add", "and", "or", "xor", "ldb", "ldw", "ldi", "ldib", "lea",
+    "stb", "stw", "sti", "stib", "br", "brn", "brnz", "brnp", "brnzp", "brzp", "brz", "brp", "jmp",
+    "jsr", "jsrr", "ret", "rti", "mul", "div", "trap", "lshf", "rshfl", "rshfa", "mov", "rot",
+    "push", "pushb", "pop", "popb", "macc", "extdb", "extdw", "halt", ".fill", ".blkw", ".stringz", ".end", ".orig"};
+
+/*
+Simple function that compares a token against a lowercase string, the token may be
+in any case.
+*/
+bool tokenEquals(token t, const char* str){
+    for (size_t i = 0; i < t.len; ++i){
+        if (str[i] == '\0' || LOWER(t.ptr[i]) != str[i]){
+            return false;
+        }
+    }
+    return str[t.len] == '\0';
+}
+
+/*
+Perfect hash of the opcode names. The key packs the first three characters, the last
+character and the length, OPCODE_HASH_MULT was searched for so that every opcode lands
+in its own slot of opcodeSlots. A slot holds the opcode + 1, 0 marks an empty slot.
+*/
+#define OPCODE_HASH_MULT 0x14ece04dU
+#define OPCODE_HASH_SHIFT 25
+#define OPCODE_MAX_LENGTH 8
+
+static const uint8_t opcodeSlots[1 << (32 - OPCODE_HASH_SHIFT)] = {
+    [0] = BRZ + 1, [7] = PUSHB + 1, [8] = STI + 1, [11] = ORIG + 1, [12] = HALT + 1,
+    [19] = RTI + 1, [21] = JSR + 1, [23] = LDI + 1, [27] = RET + 1, [29] = BRP + 1,
+    [30] = ADD + 1, [33] = JMP + 1, [39] = EXTW + 1, [40] = TRAP + 1, [44] = END + 1,
+    [46] = MUL + 1, [48] = FILL + 1, [51] = BRZP + 1, [55] = RSHFA + 1, [58] = DIV + 1,
+    [60] = ROT + 1, [62] = AND + 1, [64] = LDIB + 1, [68] = STIB + 1, [70] = STW + 1,
+    [73] = JSRR + 1, [74] = MOV + 1, [78] = BLKW + 1, [79] = BR + 1, [84] = LDW + 1,
+    [87] = OR + 1, [88] = LEA + 1, [91] = LSHF + 1, [95] = RSHFL + 1, [100] = PUSH + 1,
+    [102] = POPB + 1, [106] = STB + 1, [108] = STRINGZ + 1, [109] = MACC + 1,
+    [112] = BRN + 1, [113] = BRNP + 1, [114] = BRNZ + 1, [118] = POP + 1, [119] = XOR + 1,
+    [120] = LDB + 1, [124] = BRNZP + 1, [127] = EXTB + 1,
+};
+
+/*
+Looks up the opcode spelled by the first length characters of inputString, ignoring
+case. Returns the opcode enum value, or NUM_OPCODES if it isn't an opcode.
+*/
+int lookupOpcode(const char* inputString, size_t length){
+    if (length < 2 || length > OPCODE_MAX_LENGTH){
+        return NUM_OPCODES;
+    }
+    const unsigned char* str = (const unsigned char*)inputString;
+    uint32_t key = (uint32_t)LOWER(str[0]) | ((uint32_t)LOWER(str[1]) << 8) | ((uint32_t)LOWER(str[length - 1]) << 24);
+    if (length > 2){
+        key |= (uint32_t)LOWER(str[2]) << 16;
+    }
+    key ^= (uint32_t)length;
+
+    int slot = opcodeSlots[(uint32_t)(key * OPCODE_HASH_MULT) >> OPCODE_HASH_SHIFT];
+    if (slot == 0){
+        return NUM_OPCODES;
+    }
+    int opcode = slot - 1;
+    token t = {inputString, length};
+    if (!tokenEquals(t, opCodes[opcode])){
+        return NUM_OPCODES;
+    }
+    return opcode;
+}
+
+const char* lowerToken(token t, char* buffer, size_t size){
+    size_t length = t.len < size ? t.len : size - 1;
+    for (size_t i = 0; i < length; ++i){
+        buffer[i] = LOWER(t.ptr[i]);
+    }
+    buffer[length] = '\0';
+    return buffer;
+}
+
+const char* opcodeName(int opcode){
+    return (opcode >= 0 && opcode < NUM_OPCODES) ? opCodes[opcode] : NULL;
+}
+
+/*
+Labels are up to 20 letters and digits, can't look like a number and can't be
+one of the trap aliases.
+*/
+bool isValidLabel(token label){
+    if (label.len > 20){
+        return false;
+    }
+    if (tokenAt(label, 0) == 'x' || isdigit((unsigned char)tokenAt(label, 0))){
+        return false;
+    }
+    if (tokenEquals(label, "in") || tokenEquals(label, "out") || tokenEquals(label, "getc") || tokenEquals(label, "puts")){
+        return false;
+    }
+    for (size_t i = 0; i < label.len; ++i){
+        if (isalnum((unsigned char)label.ptr[i]) == 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Value of a hex digit, or something above 15 if c isn't one
+static inline unsigned hexValue(char c){
+    unsigned digit = (unsigned)(c - '0');
+    if (digit <= 9){
+        return digit;
+    }
+    digit = (unsigned)((c | 0x20) - 'a');
+    return digit <= 5 ? digit + 10 : 16;
+}
+
+/*
+One pass over the token, nothing allocated and nothing reported. Values come
+out the way atoi and strtol gave them when this was done with those: decimal
+is taken modulo 2^32 until it passes LONG_MAX, where atoi stops, and hex is
+clamped to INT_MAX. The sign is applied after either.
+*/
+int parseNumber(token num, int* value)
+{
+   const char* t_ptr = num.ptr;
+   const char* t_end = num.ptr + num.len;
+   bool lNeg = false;
+
+   if (t_ptr < t_end && *t_ptr == '0'){
+    t_ptr++;
+   }
+   if( t_ptr < t_end && *t_ptr == '#' )				/* decimal */
+   {
+     t_ptr++;
+     if( t_ptr < t_end && *t_ptr == '-' )				/* dec is negative */
+     {
+       lNeg = true;
+       t_ptr++;
+     }
+     uint64_t lNum = 0;
+     for(; t_ptr < t_end; t_ptr++)
+     {
+       unsigned digit = (unsigned)(*t_ptr - '0');
+       if (digit > 9)
+	 return NUM_BAD_DECIMAL;
+       if (lNum > ((uint64_t)INT64_MAX - digit) / 10)	/* sticks at the clamp from here on */
+	 lNum = INT64_MAX;
+       else
+	 lNum = lNum * 10 + digit;
+     }
+     uint32_t lBits = (uint32_t)lNum;
+     *value = (int)(lNeg ? 0u - lBits : lBits);
+     return NUM_OK;
+   }
+   else if( t_ptr < t_end && LOWER(*t_ptr) == 'x' )	/* hex     */
+   {
+     t_ptr++;
+     if( t_ptr < t_end && *t_ptr == '-' )				/* hex is negative */
+     {
+       lNeg = true;
+       t_ptr++;
+     }
+     uint32_t lNum = 0;
+     for(; t_ptr < t_end; t_ptr++)
+     {
+       unsigned digit = hexValue(*t_ptr);
+       if (digit > 15)
+	 return NUM_BAD_HEX;
+       lNum = lNum > INT_MAX / 16 ? INT_MAX + 1u : lNum * 16 + digit;
+     }
+     int lClamped = lNum > INT_MAX ? INT_MAX : (int)lNum;
+     *value = lNeg ? -lClamped : lClamped;
+     return NUM_OK;
+   }
+   return NUM_BAD_OPERAND;
+}
+
+/*
+Converts a user given string representing a number, either in format:
+#3 or x3 into an integer value. If formatted incorrectly an error is
+reported and 0 returned
+*/
+int toNum( token num, diag_list* diags )
+{
+   int value = 0;
+   char lower[DIAG_MESSAGE_LENGTH];
+   switch (parseNumber(num, &value))
+   {
+     case NUM_BAD_DECIMAL:
+	diag_report(diags, 4, "Error: invalid decimal operand, %s", lowerToken(num, lower, sizeof(lower)));
+	return 0;
+     case NUM_BAD_HEX:
+	diag_report(diags, 4, "Error: invalid hex operand, %s", lowerToken(num, lower, sizeof(lower)));
+	return 0;
+     case NUM_BAD_OPERAND:
+	diag_report(diags, 4, "Error: invalid operand, %s", lowerToken(num, lower, sizeof(lower)));
+	return 0;  /* This has been changed from error code 3 to error code 4, see clarification 12 */
+   }
+   return value;
+}
+
+/*
+Maps the file at the given path into memory. Falls back to reading it into
+a heap buffer where mapping isn't available.
+*/
+bool openSource(source* pSource, const char* path){
+    pSource->data = NULL;
+    pSource->size = 0;
+    pSource->pos = 0;
+    pSource->line = 0;
+    pSource->mapped = false;
+    pSource->borrowed = false;
+
+#ifdef _WIN32
+    FILE* file = fopen(path, "rb");
+    if (file == NULL){
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* data = malloc(size > 0 ? size : 1);
+    if (data == NULL || fread(data, 1, size, file) != (size_t)size){
+        free(data);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+    stats_count_alloc(1);
+    pSource->data = data;
+    pSource->size = size;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)){
+        close(fd);
+        return false;
+    }
+    if (st.st_size > 0){
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED){
+            close(fd);
+            return false;
+        }
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        pSource->data = data;
+        pSource->size = st.st_size;
+        pSource->mapped = true;
+    }
+    close(fd);
+#endif
+    return true;
+}
+
+void openBuffer(source* pSource, const char* data, size_t size){
+    pSource->data = data;
+    pSource->size = size;
+    pSource->pos = 0;
+    pSource->line = 0;
+    pSource->mapped = false;
+    pSource->borrowed = true;
+}
+
+void closeSource(source* pSource){
+    if (pSource->borrowed){
+        // nothing to free
+    } else
+#ifndef _WIN32
+    if (pSource->mapped){
+        munmap((void*)pSource->data, pSource->size);
+    } else
+#endif
+    {
+        free((void*)pSource->data);
+    }
+    pSource->data = NULL;
+    pSource->size = 0;
+}
+
+void rewindSource(source* pSource){
+    pSource->pos = 0;
+    pSource->line = 0;
+}
+
+size_t countLines(const source* pSource){
+    size_t lines = 0;
+    const char* lPtr = pSource->data;
+    const char* lEnd = pSource->data + pSource->size;
+    while (lPtr < lEnd){
+        const char* lNewline = memchr(lPtr, '\n', lEnd - lPtr);
+        lines++;
+        if (lNewline == NULL){
+            break;
+        }
+        lPtr = lNewline + 1;
+    }
+    return lines;
+}
+
+// Characters separating the tokens of a line
+static inline bool isDelimiter(char c){
+    return c == ' ' || c == '\t' || c == ',' || c == '\r' || c == '\n';
+}
+
+/*
+Where the tokens of a line are. A line whose code fits in one scanned block has
+them as the runs of set bits in words, a longer one is walked a byte at a time
+from ptr.
+*/
+typedef struct {
+    const char* ptr;  // start of the block words is for, or where to carry on scanning from
+    const char* end;  // end of the code of the line
+    uint64_t words;   // a bit for every byte of a token not yet returned
+    bool scanned;     // the line fit in the block and words is used
+} line_cursor;
+
+/*
+Finds the next token of the line, returns false if there is none.
+*/
+static inline bool nextToken(line_cursor* pCursor, token* pToken){
+    if (pCursor->scanned){
+        uint64_t lWords = pCursor->words;
+        if (lWords == 0){
+            return false;
+        }
+        unsigned lStart = scan_first(lWords);
+        pToken->ptr = pCursor->ptr + lStart;
+        pToken->len = scan_first(~(lWords >> lStart)); /* bits from the end of the code on are clear */
+        pCursor->words = lWords & (lWords + (1ull << lStart)); /* drop the lowest run */
+        return true;
+    }
+    const char* lPtr = pCursor->ptr;
+    const char* end = pCursor->end;
+    while (lPtr < end && isDelimiter(*lPtr)){
+        lPtr++;
+    }
+    if (lPtr == end){
+        return false;
+    }
+    pToken->ptr = lPtr;
+    while (lPtr < end && !isDelimiter(*lPtr)){
+        lPtr++;
+    }
+    pToken->len = lPtr - pToken->ptr;
+    pCursor->ptr = lPtr;
+    return true;
+}
+
+/*
+Function that reads a line of text from the source and 
+parses the line for the data held inside. Tokens point into the
+source, nothing is copied or modified. The first block of the line
+is classified in one go by the scanner, which finds the newline or
+comment ending its code and the delimiters between its tokens.
+*/
+int readAndParse( source* pSource, token* pLabel, token* pOpcode,
+	token* pArg1, token* pArg2, token* pArg3, token* pArg4,
+	int* pOpcodeId
+	)
+	{
+	  if( pSource->pos >= pSource->size )
+	    return( DONE );
+
+	  const char* lPtr = pSource->data + pSource->pos;
+	  const char* lEnd = pSource->data + pSource->size;
+	  size_t lLeft = lEnd - lPtr;
+	  line_cursor lCursor;
+	  scan_mask lMask = scan_block( lPtr, lLeft );
+	  if( lMask.stops != 0 )		/* code ends in the block */
+	  {
+		  unsigned lStop = scan_first( lMask.stops );
+		  const char* lNewline = NULL;
+		  if( lStop < lLeft )
+		  {
+			  lNewline = lPtr[lStop] == '\n' ? lPtr + lStop :	/* otherwise a comment */
+				  memchr( lPtr + lStop, '\n', lLeft - lStop );
+			  lLeft = lStop;
+		  }
+		  pSource->pos = ( ( lNewline != NULL ? lNewline : lEnd ) - pSource->data ) + 1;
+		  lCursor.ptr = lPtr;
+		  lCursor.end = lPtr + lLeft;
+		  lCursor.words = ~lMask.delimiters & ( ( 1ull << lStop ) - 1 );
+		  lCursor.scanned = true;
+	  }
+	  else
+	  {
+		  const char* lNewline = memchr( lPtr, '\n', lLeft );
+		  if( lNewline != NULL )
+			  lEnd = lNewline;
+		  pSource->pos = ( lEnd - pSource->data ) + 1;
+
+		  /* ignore the comments */
+		  const char* lComment = memchr( lPtr, ';', lEnd - lPtr );
+		  if( lComment != NULL )
+			  lEnd = lComment;
+		  lCursor.ptr = lPtr;
+		  lCursor.end = lEnd;
+		  lCursor.words = 0;
+		  lCursor.scanned = false;
+	  }
+	  pSource->line++;
+
+	  token lEmpty = { lCursor.end, 0 };
+	  *pLabel = *pOpcode = *pArg1 = *pArg2 = *pArg3 = *pArg4 = lEmpty;
+	  *pOpcodeId = NUM_OPCODES;
+
+	  token lTok;
+	  if( !nextToken( &lCursor, &lTok ) )
+		  return( EMPTY_LINE );
+
+	  *pOpcodeId = lookupOpcode( lTok.ptr, lTok.len );
+	  if( *pOpcodeId == NUM_OPCODES && lTok.ptr[0] != '.' ) /* found a label */
+	  {
+		  *pLabel = lTok;
+		  if( !nextToken( &lCursor, &lTok ) ) return( OK );
+		  *pOpcodeId = lookupOpcode( lTok.ptr, lTok.len );
+	  }
+	   
+           *pOpcode = lTok;
+
+	   if( !nextToken( &lCursor, pArg1 ) ) return( OK );
+	   if( !nextToken( &lCursor, pArg2 ) ) return( OK );
+	   if( !nextToken( &lCursor, pArg3 ) ) return( OK );
+	   nextToken( &lCursor, pArg4 );
+
+	   return( OK );
+	}
@@ -1,194 +1,384 @@
-#include "ht.h"
-#include "string.h"
-#include "assert.h"
-
-#define FNV_OFFSET 14695981039346656037UL
-#define FNV_PRIME 1099511628211UL
-
-// Return 64-bit FNV-1a hash for key (NUL-terminated)
-static uint64_t hash_key(const char* key){
-    uint64_t hash = FNV_OFFSET;
-    for (const char* p = key; *p; p++){
-        hash ^= (uint64_t)(unsigned char)(*p);
-        hash *= FNV_PRIME;
-    }
-    return hash;
-}
-
-typedef struct {
-    const char* key; // key is NULL if this slot is empty
-    void* value;
-} ht_entry;
-
-struct ht {
-    ht_entry* entries; // hash slots
-    size_t capacity;   // size of _entries array
-    size_t length;     //number of items in hash table
-};
-
-#define INITIAL_CAPACITY 16
-static bool ht_expand(ht* table);
-static const char* ht_set_entry(ht_entry* entries, size_t capacity, const char* key, void* value, size_t* pLength);
-
-
-
-ht* ht_create(void){
-    //Allocate space for hash table struct
-    ht* table = malloc(sizeof(ht));
-    if (table == NULL){
-        return NULL;
-    }
-    table->length = 0;
-    table->capacity = INITIAL_CAPACITY;
-
-
-    //Allocate (zero'd) space for entry buckets.
-    table->entries = (ht_entry*)calloc(table->capacity,sizeof(ht_entry));
-
-    if (table->entries == NULL){
-        free(table); // free table before return
-        return NULL; 
-    }
-    return table;
-}
-
-void ht_destroy(ht* table){
-    // first free allocated keys
-    for (size_t i = 0; i < table->capacity; i++){
-        free((void*)table->entries[i].key);
-        free(table->entries[i].value);
-    }
-    //then free entries array and table itself
-    free(table->entries);
-    free(table);
-}
-
-void* ht_get(ht* table, const char* key){
-    // AND hash with capacity-1 to ensure its within entries array.
-    uint64_t hash = hash_key(key);
-    size_t index = (size_t)(hash & (uint64_t)(table->capacity - 1));
-
-    // Loop till we find an empty entry
-
-    while (table->entries[index].key != NULL){
-        if (strcmp(key, table->entries[index].key) == 0){
-            // found key return value
-            return table->entries[index].value;
-    }
-        // key wasnt in this slot, move to next
-        index++;
-        if (index >= table->capacity){
-            // at end of entries array, wrap around
-            index = 0;
-        }
-    }
-    return NULL;
-}
-
-const char* ht_set(ht* table, const char* key, void* value){
-    assert(value != NULL);
-    if (value == NULL)
-        return NULL;
-        //if length will exceed half of current capacity, expand it
-    if (table->length >= table->capacity / 2){
-        if (!ht_expand(table))
-            return NULL;
-    }
-
-    // set entry and update length
-    return ht_set_entry(table->entries, table->capacity, key, value, &table->length);
-}
-
-
-//Internal function to set entry
-static const char* ht_set_entry(ht_entry* entries,size_t capacity,
-    const char* key, void* value, size_t* pLength){
-    //AND hash with capacity-1 to ensure it is within entries array.
-    uint64_t hash = hash_key(key);
-    size_t index = (size_t)(hash & (uint64_t)(capacity-1));
-
-    //Loop till we find an empty entry
-    while(entries[index].key != NULL){
-        if (strcmp(key, entries[index].key) == 0){
-            //found key ( it already exists), update value
-            entries[index].value = value;
-            return entries[index].key;
-        }
-        //Key wasn't in this slot, move to next(Linear Probing)
-        index++;
-        if (index >= capacity){
-            // At end of entries array, wrap around
-            index = 0;
-        }
-    }
-
-    // didn't find key, allocate+copy if needed
-    if (pLength != NULL){
-        key = strdup(key);
-        if (key == NULL){
-            return NULL;
-        }
-        (*pLength)++;
-    }
-    entries[index].key = (char*)key;
-    entries[index].value = value;
-    return key;
-
-}
-
-
-//expand hash table to twice curr size
-static bool ht_expand(ht* table){
-    //Allocate new entries array
-    size_t new_capacity = table->capacity * 2;
-    if (new_capacity < table->capacity){
-        return false; // overflow (capacity would be too big)
-    }
-
-    ht_entry* new_entries = calloc(new_capacity, sizeof(ht_entry));
-    if (new_entries == NULL){
-        return false;
-    }
-
-    //Iterate entries, move all non-empty ones to new table's entries
-    for (size_t i = 0; i < table->capacity; i++){
-        ht_entry entry = table->entries[i];
-        if (entry.key != NULL){
-            ht_set_entry(new_entries, new_capacity,entry.key, entry.value, NULL);
-
-        }
-    }
-
-    free(table->entries);
-    table->entries = new_entries;
-    table->capacity = new_capacity;
-    return true;
-}
-
-size_t ht_length(ht* table){
-    return table->length;
-}
-
-hti ht_iterator(ht* table){
-    hti it;
-    it._table = table;
-    it._index = 0;
-    return it;
-}
-
-bool ht_next(hti* it){
-    //Loop till we've ht end of entries array.
-    ht* table = it->_table;
-    while (it->_index < table->capacity){
-        size_t i = it->_index;
-        it->_index++;
-        if (table->entries[i].key != NULL){
-            //found next non-empty item, update iterator key and value.
-            ht_entry entry = table->entries[i];
-            it->key = entry.key;
-            it->value = entry.value;
-            return true;
-        }
-    }
-        return false;
-}
\ No newline at end of file
+#include "ht.h"
+#include "stats.h"
+#include "string.h"
+#include "assert.h"
+
+#define FNV_OFFSET 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+
+// Lowercase an ASCII character, keys are compared ignoring case
+#define FOLD(c) (((c) >= 'A' && (c) <= 'Z') ? ((c) | 0x20) : (c))
+
+uint64_t ht_hash(const char* key, size_t length){
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < length; i++){
+        hash ^= (uint64_t)(unsigned char)FOLD(key[i]);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Return true if the stored (lowercase, NUL-terminated) key matches the given key
+static bool key_equals(const char* stored, const char* key, size_t length){
+    for (size_t i = 0; i < length; i++){
+        if (stored[i] != FOLD(key[i])){
+            return false;
+        }
+    }
+    return stored[length] == '\0';
+}
+
+// Return a lowercase, NUL-terminated copy of key allocated from the arena if there is one,
+// or NULL if out of memory
+static char* copy_key(arena* keys, const char* key, size_t length){
+    char* copy = keys != NULL ? arena_alloc(keys, length + 1) : malloc(length + 1);
+    if (copy == NULL){
+        return NULL;
+    }
+    if (keys == NULL){
+        stats_count_alloc(1);
+    }
+    for (size_t i = 0; i < length; i++){
+        copy[i] = FOLD(key[i]);
+    }
+    copy[length] = '\0';
+    return copy;
+}
+
+typedef struct {
+    const char* key; // key is NULL if this slot is empty
+    uint64_t hash;   // hash of the key, kept so expanding never rehashes
+    union {
+        void* ptr;   // value set with ht_set
+        int num;     // value set with ht_set_int, stored inline
+    } value;
+} ht_entry;
+
+struct ht {
+    ht_entry* entries; // hash slots
+    size_t capacity;   // size of _entries array
+    size_t length;     //number of items in hash table
+    size_t limit;      // length at which the table expands
+    double max_load;   // fraction of slots used before expanding
+    size_t expansions; // times the table doubled
+    arena* arena;      // owns keys and values, NULL if they are malloc'd
+
+    // While an incremental expansion is in progress the items are spread over the
+    // old slots and entries. Old slots below migrated have been copied over, the
+    // rest are still only in the old slots unless their key is MOVED.
+    bool incremental;       // spread expansions over the following operations
+    ht_entry* old_entries;  // slots being migrated from, NULL if not expanding
+    size_t old_capacity;    // size of old_entries array
+    size_t migrated;        // old slots copied so far
+};
+
+#define INITIAL_CAPACITY 16
+#define DEFAULT_MAX_LOAD 0.5
+#define MIGRATE_STEP 16 // old slots moved by every get and set while expanding
+
+// Key of an old slot whose item was moved ahead of the migration, keeps probe chains intact
+static const char moved_key[] = "";
+#define MOVED moved_key
+
+static bool ht_expand(ht* table);
+static const char* ht_set_value(ht* table, const char* key, size_t length, ht_entry value);
+static ht_entry* ht_find(ht* table, const char* key, size_t length);
+
+
+
+// Return the number of slots needed to hold expected items under max_load, a power of 2
+static size_t capacity_for(size_t expected, double max_load){
+    size_t capacity = INITIAL_CAPACITY;
+    while (capacity * max_load <= expected && capacity * 2 > capacity){
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+ht* ht_create(void){
+    return ht_create_with_capacity(0, NULL);
+}
+
+ht* ht_create_with_capacity(size_t expected, arena* a){
+    //Allocate space for hash table struct
+    ht* table = malloc(sizeof(ht));
+    if (table == NULL){
+        return NULL;
+    }
+    table->length = 0;
+    table->max_load = DEFAULT_MAX_LOAD;
+    table->capacity = capacity_for(expected, table->max_load);
+    table->limit = (size_t)(table->capacity * table->max_load);
+    table->expansions = 0;
+    table->arena = a;
+    table->incremental = false;
+    table->old_entries = NULL;
+    table->old_capacity = 0;
+    table->migrated = 0;
+
+
+    //Allocate (zero'd) space for entry buckets.
+    table->entries = (ht_entry*)calloc(table->capacity,sizeof(ht_entry));
+
+    if (table->entries == NULL){
+        free(table); // free table before return
+        return NULL; 
+    }
+    stats_count_alloc(2);
+    return table;
+}
+
+ht* ht_create_arena(arena* a){
+    return ht_create_with_capacity(0, a);
+}
+
+// Put an item whose key isn't in entries yet into the first free slot from its home slot
+static void insert_entry(ht_entry* entries, size_t capacity, ht_entry entry){
+    size_t index = (size_t)(entry.hash & (uint64_t)(capacity - 1));
+    while (entries[index].key != NULL){
+        index = (index + 1) & (capacity - 1);
+    }
+    entries[index] = entry;
+}
+
+// Copy up to count more old slots into entries, the old slots are freed once they're all done
+static void ht_migrate(ht* table, size_t count){
+    if (table->old_entries == NULL){
+        return;
+    }
+    size_t left = table->old_capacity - table->migrated;
+    size_t end = table->migrated + (count < left ? count : left);
+    for (size_t i = table->migrated; i < end; i++){
+        ht_entry entry = table->old_entries[i];
+        if (entry.key != NULL && entry.key != MOVED){
+            insert_entry(table->entries, table->capacity, entry);
+        }
+    }
+    table->migrated = end;
+    if (end == table->old_capacity){
+        free(table->old_entries);
+        table->old_entries = NULL;
+        table->old_capacity = 0;
+        table->migrated = 0;
+    }
+}
+
+void ht_destroy(ht* table){
+    ht_migrate(table, SIZE_MAX);
+    // first free allocated keys, the arena takes care of them if there is one
+    for (size_t i = 0; table->arena == NULL && i < table->capacity; i++){
+        free((void*)table->entries[i].key);
+        free(table->entries[i].value.ptr);
+    }
+    //then free entries array and table itself
+    free(table->entries);
+    free(table);
+}
+
+void* ht_get(ht* table, const char* key){
+    return ht_getn(table, key, strlen(key));
+}
+
+void* ht_getn(ht* table, const char* key, size_t length){
+    ht_entry* entry = ht_find(table, key, length);
+    return entry != NULL ? entry->value.ptr : NULL;
+}
+
+bool ht_getn_int(ht* table, const char* key, size_t length, int* value){
+    ht_entry* entry = ht_find(table, key, length);
+    if (entry == NULL){
+        return false;
+    }
+    *value = entry->value.num;
+    return true;
+}
+
+// Return the slot of entries holding key, or NULL if key not found
+static ht_entry* find_entry(ht_entry* entries, size_t capacity, uint64_t hash, const char* key, size_t length){
+    // AND hash with capacity-1 to ensure its within entries array.
+    size_t index = (size_t)(hash & (uint64_t)(capacity - 1));
+
+    // Loop till we find an empty entry, the stored hash rules out most slots
+    while (entries[index].key != NULL){
+        ht_entry* entry = &entries[index];
+        if (entry->hash == hash && entry->key != MOVED && key_equals(entry->key, key, length)){
+            return entry;
+        }
+        // key wasnt in this slot, move to next (wrapping around at the end)
+        index = (index + 1) & (capacity - 1);
+    }
+    return NULL;
+}
+
+// Return the slot holding key, or NULL if key not found
+static ht_entry* ht_find(ht* table, const char* key, size_t length){
+    ht_migrate(table, MIGRATE_STEP);
+    uint64_t hash = ht_hash(key, length);
+    ht_entry* entry = find_entry(table->entries, table->capacity, hash, key, length);
+    if (entry == NULL && table->old_entries != NULL){
+        entry = find_entry(table->old_entries, table->old_capacity, hash, key, length);
+    }
+    return entry;
+}
+
+const char* ht_set(ht* table, const char* key, void* value){
+    return ht_setn(table, key, strlen(key), value);
+}
+
+const char* ht_setn(ht* table, const char* key, size_t length, void* value){
+    assert(value != NULL);
+    if (value == NULL)
+        return NULL;
+    ht_entry entry = {NULL, 0, {.ptr = value}};
+    return ht_set_value(table, key, length, entry);
+}
+
+const char* ht_setn_int(ht* table, const char* key, size_t length, int value){
+    assert(table->arena != NULL);
+    ht_entry entry = {NULL, 0, {.num = value}};
+    return ht_set_value(table, key, length, entry);
+}
+
+static const char* ht_set_value(ht* table, const char* key, size_t length, ht_entry value){
+    ht_migrate(table, MIGRATE_STEP);
+    uint64_t hash = ht_hash(key, length);
+    ht_entry* entry = find_entry(table->entries, table->capacity, hash, key, length);
+    if (entry == NULL && table->old_entries != NULL){
+        ht_entry* old = find_entry(table->old_entries, table->old_capacity, hash, key, length);
+        if (old != NULL){
+            // not migrated yet, move it now so the new value only lives in one place
+            ht_entry moved = *old;
+            moved.value = value.value;
+            old->key = MOVED;
+            insert_entry(table->entries, table->capacity, moved);
+            return moved.key;
+        }
+    }
+    if (entry != NULL){
+        //found key ( it already exists), update value
+        entry->value = value.value;
+        return entry->key;
+    }
+
+    //if length will exceed the max load of current capacity, expand it
+    if (table->length >= table->limit){
+        if (!ht_expand(table))
+            return NULL;
+    }
+
+    // didn't find key, allocate+copy it
+    value.key = copy_key(table->arena, key, length);
+    if (value.key == NULL){
+        return NULL;
+    }
+    value.hash = hash;
+    insert_entry(table->entries, table->capacity, value);
+    table->length++;
+    return value.key;
+}
+
+
+/*
+expand hash table to twice curr size. The items are moved over right away, or
+a few slots at a time by the following gets and sets in incremental mode.
+*/
+static bool ht_expand(ht* table){
+    // an expansion still in progress has to finish before the next one starts
+    ht_migrate(table, SIZE_MAX);
+
+    //Allocate new entries array
+    size_t new_capacity = table->capacity * 2;
+    if (new_capacity < table->capacity){
+        return false; // overflow (capacity would be too big)
+    }
+
+    ht_entry* new_entries = calloc(new_capacity, sizeof(ht_entry));
+    if (new_entries == NULL){
+        return false;
+    }
+    stats_count_alloc(1);
+
+    table->old_entries = table->entries;
+    table->old_capacity = table->capacity;
+    table->migrated = 0;
+    table->entries = new_entries;
+    table->capacity = new_capacity;
+    table->limit = (size_t)(new_capacity * table->max_load);
+    table->expansions++;
+    if (!table->incremental){
+        ht_migrate(table, SIZE_MAX);
+    }
+    return true;
+}
+
+size_t ht_length(ht* table){
+    return table->length;
+}
+
+void ht_set_max_load(ht* table, double load){
+    table->max_load = load < 0.1 ? 0.1 : (load > 0.9 ? 0.9 : load);
+    table->limit = (size_t)(table->capacity * table->max_load);
+}
+
+void ht_set_incremental(ht* table, bool incremental){
+    table->incremental = incremental;
+    if (!incremental){
+        ht_migrate(table, SIZE_MAX);
+    }
+}
+
+// Add the probe lengths of the items in slots from first on to stats
+static size_t add_probes(ht_stats* stats, const ht_entry* entries, size_t capacity, size_t first){
+    size_t total = 0;
+    for (size_t i = first; i < capacity; i++){
+        const ht_entry* entry = &entries[i];
+        if (entry->key != NULL && entry->key != MOVED){
+            // a lookup reads every slot from the home slot up to this one
+            size_t home = (size_t)(entry->hash & (uint64_t)(capacity - 1));
+            size_t probe = ((i - home) & (capacity - 1)) + 1;
+            total += probe;
+            stats->collisions += probe > 1;
+            stats->max_probe = probe > stats->max_probe ? probe : stats->max_probe;
+            stats->probes[probe < HT_PROBE_BUCKETS ? probe - 1 : HT_PROBE_BUCKETS - 1]++;
+        }
+    }
+    return total;
+}
+
+void ht_info(ht* table, ht_stats* stats){
+    memset(stats, 0, sizeof(ht_stats));
+    size_t total = add_probes(stats, table->entries, table->capacity, 0);
+    if (table->old_entries != NULL){
+        total += add_probes(stats, table->old_entries, table->old_capacity, table->migrated);
+    }
+    stats->length = table->length;
+    stats->capacity = table->capacity;
+    stats->expansions = table->expansions;
+    stats->mean_probe = table->length > 0 ? (double)total / table->length : 0;
+}
+
+hti ht_iterator(ht* table){
+    // items are only walked in entries, so finish any expansion first
+    ht_migrate(table, SIZE_MAX);
+    hti it;
+    it._table = table;
+    it._index = 0;
+    return it;
+}
+
+bool ht_next(hti* it){
+    //Loop till we've ht end of entries array.
+    ht* table = it->_table;
+    while (it->_index < table->capacity){
+        size_t i = it->_index;
+        it->_index++;
+        if (table->entries[i].key != NULL){
+            //found next non-empty item, update iterator key and value.
+            ht_entry entry = table->entries[i];
+            it->key = entry.key;
+            it->value = entry.value.ptr;
+            return true;
+        }
+    }
+        return false;
+}
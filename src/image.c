@@ -0,0 +1,126 @@
+#include "image.h"
+#include "stats.h"
+#include <string.h>
+
+#define INITIAL_WORDS 256
+
+image* image_create(void){
+    image* img = malloc(sizeof(image));
+    if (img == NULL){
+        return NULL;
+    }
+    img->orig = 0;
+    img->length = 0;
+    img->capacity = INITIAL_WORDS;
+    img->words = (uint16_t*)malloc(img->capacity * sizeof(uint16_t));
+    img->regions = NULL;
+    img->region_count = 0;
+    img->region_capacity = 0;
+    img->zeros = 0;
+
+    if (img->words == NULL){
+        free(img);
+        return NULL;
+    }
+    stats_count_alloc(2);
+    return img;
+}
+
+void image_destroy(image* img){
+    free(img->words);
+    free(img->regions);
+    free(img);
+}
+
+bool image_grow(image* img){
+    size_t new_capacity = img->capacity * 2;
+    if (new_capacity < img->capacity){
+        return false; // overflow (capacity would be too big)
+    }
+
+    uint16_t* new_words = realloc(img->words, new_capacity * sizeof(uint16_t));
+    if (new_words == NULL){
+        return false;
+    }
+    stats_count_alloc(1);
+    img->words = new_words;
+    img->capacity = new_capacity;
+    return true;
+}
+
+bool image_reserve(image* img, size_t extra){
+    if (img->length + extra > img->capacity){
+        size_t new_capacity = img->capacity;
+        while (new_capacity < img->length + extra){
+            new_capacity *= 2;
+        }
+        uint16_t* new_words = realloc(img->words, new_capacity * sizeof(uint16_t));
+        if (new_words == NULL){
+            return false;
+        }
+        stats_count_alloc(1);
+        img->words = new_words;
+        img->capacity = new_capacity;
+    }
+    return true;
+}
+
+bool image_reserve_regions(image* img, size_t extra){
+    if (img->region_count + extra <= img->region_capacity){
+        return true;
+    }
+    size_t new_capacity = img->region_capacity > 0 ? img->region_capacity : 8;
+    while (new_capacity < img->region_count + extra){
+        new_capacity *= 2;
+    }
+    image_region* new_regions = realloc(img->regions, new_capacity * sizeof(image_region));
+    if (new_regions == NULL){
+        return false;
+    }
+    stats_count_alloc(1);
+    img->regions = new_regions;
+    img->region_capacity = new_capacity;
+    return true;
+}
+
+// Append a region whatever its size, regions must have room for it
+static void add_region(image* img, size_t count){
+    img->regions[img->region_count].at = img->length;
+    img->regions[img->region_count].count = count;
+    img->region_count++;
+    img->zeros += count;
+}
+
+bool image_fill(image* img, size_t count){
+    if (count >= IMAGE_FILL_MIN){
+        if (!image_reserve_regions(img, 1)){
+            return false;
+        }
+        add_region(img, count);
+        return true;
+    }
+    if (!image_reserve(img, count)){
+        return false;
+    }
+    memset(img->words + img->length, 0, count * sizeof(uint16_t));
+    img->length += count;
+    return true;
+}
+
+bool image_append(image* dst, const image* src){
+    if (!image_reserve(dst, src->length) || !image_reserve_regions(dst, src->region_count)){
+        return false;
+    }
+    size_t first = dst->length;
+    for (size_t i = 0; i < src->region_count; ++i){
+        // stored words of src up to the region, then the region itself
+        size_t at = first + src->regions[i].at;
+        memcpy(dst->words + dst->length, src->words + (dst->length - first), (at - dst->length) * sizeof(uint16_t));
+        dst->length = at;
+        add_region(dst, src->regions[i].count);
+    }
+    memcpy(dst->words + dst->length, src->words + (dst->length - first),
+        (first + src->length - dst->length) * sizeof(uint16_t));
+    dst->length = first + src->length;
+    return true;
+}
@@ -0,0 +1,349 @@
+#include "ir.h"
+#include "stats.h"
+
+// Label id of a line lexed by a segment, interned once the segments are joined
+#define IR_PENDING_LABEL -2
+
+/*
+A slice of the source lexed on a thread of its own. Lines are numbered from the
+start of the slice and labels are interned only once every slice is lexed and
+the table has been made big enough for all of them, so the text of every label
+defined is kept until then.
+*/
+struct ir_segment {
+    asm_ir ir;             // lines of the slice
+    size_t start;          // source offset of the slice
+    size_t end;            // source offset just past it
+    size_t first;          // index of its first line once the segments are joined
+    int lines;             // lines before the slice once the segments are joined
+    token* labels;         // labels defined in the slice, in order
+    size_t label_count;    // number of labels
+    size_t label_capacity; // size of labels array
+    size_t refs;           // label operands in the slice
+    bool ok;               // false if out of memory
+};
+
+void ir_init(asm_ir* ir){
+    ir->lines = NULL;
+    ir->length = 0;
+    ir->capacity = 0;
+    ir->data = NULL;
+    ir->size = 0;
+    ir->total = 0;
+    ir->orig = 0;
+    ir->segments = NULL;
+    ir->segment_capacity = 0;
+}
+
+void ir_free(asm_ir* ir){
+    for (size_t i = 0; i < ir->segment_capacity; ++i){
+        ir_free(&ir->segments[i].ir);
+        free(ir->segments[i].labels);
+    }
+    free(ir->segments);
+    free(ir->lines);
+    ir_init(ir);
+}
+
+int ir_label_operand(int opcode){
+    switch (opcode){
+        case LDI: case LDIB: case LEA: case STI: case STIB:
+            return 1;
+        case BR: case BRN: case BRNZ: case BRNP: case BRNZP: case BRZP: case BRZ: case BRP:
+        case JSR:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+// Work out the kind and value of operand i of an instruction with the given opcode,
+// return -1 if out of memory. Label operands are left for later without a table.
+static int classify(token arg, int i, int opcode, symtab* table, int32_t* value){
+    if (arg.len == 0){
+        return OPERAND_NONE;
+    }
+    if (i == ir_label_operand(opcode)){
+        if (table == NULL){
+            *value = IR_NO_LABEL;
+            return OPERAND_LABEL;
+        }
+        *value = symtab_intern(table, arg.ptr, arg.len);
+        return *value >= 0 ? OPERAND_LABEL : -1;
+    }
+    // same checks as a register operand gets when it's encoded
+    if (tokenAt(arg, 0) == 'r' && isdigit((unsigned char)tokenAt(arg, 1)) && tokenAt(arg, 1) - '0' <= 7){
+        *value = tokenAt(arg, 1) - '0';
+        return OPERAND_REGISTER;
+    }
+    size_t start = tokenAt(arg, 0) == '0' ? 1 : 0;
+    if (tokenAt(arg, start) == '#' || (tokenAt(arg, start) | 0x20) == 'x'){
+        int number;
+        if (parseNumber(arg, &number) == NUM_OK){
+            *value = number;
+            return OPERAND_NUMBER;
+        }
+    }
+    return OPERAND_TEXT;
+}
+
+/*
+Lex the lines of input up to its end into ir. Labels are interned into table, or
+with no table left pending and their text added to the labels of segment.
+*/
+static bool lex(asm_ir* ir, source* input, symtab* table, ir_segment* segment){
+    ir->length = 0;
+    ir->total = 0;
+    int firstLine = input->line;
+    token label, opcode, args[4];
+    int opcodeId;
+    bool origFound = false;
+    for (;;){
+        size_t pos = input->pos;
+        int lret = readAndParse(input, &label, &opcode, &args[0], &args[1], &args[2], &args[3], &opcodeId);
+        if (lret == DONE){
+            break;
+        }
+        if (lret != OK){
+            continue;
+        }
+        if (ir->length == ir->capacity){
+            size_t new_capacity = ir->capacity ? ir->capacity * 2 : 256;
+            ir_line* new_lines = realloc(ir->lines, new_capacity * sizeof(ir_line));
+            if (new_lines == NULL){
+                return false;
+            }
+            stats_count_alloc(1);
+            ir->lines = new_lines;
+            ir->capacity = new_capacity;
+        }
+
+        ir_line* line = &ir->lines[ir->length];
+        line->pos = (uint32_t)pos;
+        line->line = (uint32_t)(input->line - firstLine);
+        line->opcode = (uint8_t)opcodeId;
+        line->flags = 0;
+        line->kinds = 0;
+        line->label = IR_NO_LABEL;
+        if (label.len > 0){
+            if (!isValidLabel(label)){
+                line->flags |= IR_BAD_LABEL;
+            } else if (table == NULL){
+                if (segment->label_count == segment->label_capacity){
+                    size_t new_capacity = segment->label_capacity ? segment->label_capacity * 2 : 64;
+                    token* new_labels = realloc(segment->labels, new_capacity * sizeof(token));
+                    if (new_labels == NULL){
+                        return false;
+                    }
+                    stats_count_alloc(1);
+                    segment->labels = new_labels;
+                    segment->label_capacity = new_capacity;
+                }
+                segment->labels[segment->label_count++] = label;
+                line->label = IR_PENDING_LABEL;
+            } else if ((line->label = symtab_intern(table, label.ptr, label.len)) < 0){
+                return false;
+            }
+        }
+        for (int i = 0; i < 4; ++i){
+            ir_operand* arg = &line->args[i];
+            size_t offset = args[i].len > 0 ? (size_t)(args[i].ptr - (input->data + pos)) : 0;
+            if (offset + args[i].len > UINT16_MAX){
+                line->flags |= IR_LONG_LINE;
+            }
+            arg->offset = (uint16_t)offset;
+            arg->length = (uint16_t)args[i].len;
+            arg->value = 0;
+            int kind = classify(args[i], i, opcodeId, table, &arg->value);
+            if (kind < 0){
+                return false;
+            }
+            if (kind == OPERAND_LABEL && table == NULL){
+                segment->refs++;
+            }
+            line->kinds |= (uint16_t)(kind << (4 * i));
+        }
+        if (!origFound && opcodeId == ORIG){
+            ir->orig = ir->length;
+            origFound = true;
+        }
+        ir->length++;
+    }
+    ir->total = input->line - firstLine;
+    if (!origFound){
+        ir->orig = ir->length;
+    }
+    return true;
+}
+
+// Shared state of the tasks of a parallel build
+typedef struct {
+    asm_ir* ir;
+    ir_segment* segments;
+    symtab* table;
+} build_job;
+
+// Lex a segment of the source on its own
+static void lexSegment(void* arg, size_t index, int thread){
+    build_job* job = arg;
+    (void)thread;
+    ir_segment* segment = &job->segments[index];
+    source input;
+    openBuffer(&input, job->ir->data, segment->end);
+    input.pos = segment->start;
+    segment->label_count = 0;
+    segment->refs = 0;
+    segment->ok = lex(&segment->ir, &input, NULL, segment);
+}
+
+/*
+Copy a lexed segment to its place in the joined lines, numbering them from the
+start of the source, and intern its labels alongside the other segments.
+*/
+static void joinSegment(void* arg, size_t index, int thread){
+    build_job* job = arg;
+    (void)thread;
+    asm_ir* ir = job->ir;
+    ir_segment* segment = &job->segments[index];
+    if (segment->ir.length > 0){
+        memcpy(ir->lines + segment->first, segment->ir.lines, segment->ir.length * sizeof(ir_line));
+    }
+    token args[4];
+    size_t label = 0;
+    for (size_t i = segment->first; i < segment->first + segment->ir.length; ++i){
+        ir_line* line = &ir->lines[i];
+        line->line += (uint32_t)segment->lines;
+        if (line->label == IR_PENDING_LABEL){
+            token text = segment->labels[label++];
+            if ((line->label = symtab_intern_shared(job->table, text.ptr, text.len)) < 0){
+                segment->ok = false;
+                return;
+            }
+        }
+        int k = ir_label_operand(line->opcode);
+        if (k >= 0 && ir_kind(line, k) == OPERAND_LABEL){
+            ir_operands(ir, i, args);
+            if ((line->args[k].value = symtab_intern_shared(job->table, args[k].ptr, args[k].len)) < 0){
+                segment->ok = false;
+                return;
+            }
+        }
+    }
+}
+
+// Split the source into segments ending at line ends, return how many there are or 0 if out of memory
+static size_t splitSegments(asm_ir* ir){
+    size_t count = 0;
+    size_t pos = 0;
+    while (pos < ir->size){
+        if (count == ir->segment_capacity){
+            size_t new_capacity = ir->segment_capacity ? ir->segment_capacity * 2 : 16;
+            ir_segment* new_segments = realloc(ir->segments, new_capacity * sizeof(ir_segment));
+            if (new_segments == NULL){
+                return 0;
+            }
+            stats_count_alloc(1);
+            for (size_t i = ir->segment_capacity; i < new_capacity; ++i){
+                ir_init(&new_segments[i].ir);
+                new_segments[i].labels = NULL;
+                new_segments[i].label_count = 0;
+                new_segments[i].label_capacity = 0;
+            }
+            ir->segments = new_segments;
+            ir->segment_capacity = new_capacity;
+        }
+        ir_segment* segment = &ir->segments[count++];
+        segment->start = pos;
+        size_t end = pos + IR_SEGMENT_BYTES < ir->size ? pos + IR_SEGMENT_BYTES : ir->size;
+        const char* newline = end < ir->size ? memchr(ir->data + end, '\n', ir->size - end) : NULL;
+        segment->end = newline != NULL ? (size_t)(newline - ir->data) + 1 : ir->size;
+        pos = segment->end;
+    }
+    return count;
+}
+
+bool ir_build(asm_ir* ir, source* input, symtab* table, threadpool* pool){
+    ir->length = 0;
+    ir->data = input->data;
+    ir->size = input->size;
+    ir->total = 0;
+    if (input->size > UINT32_MAX){
+        return false;
+    }
+    if (pool == NULL || input->size <= IR_SEGMENT_BYTES){
+        return lex(ir, input, table, NULL);
+    }
+
+    size_t count = splitSegments(ir);
+    if (count == 0){
+        return false;
+    }
+    build_job job = {ir, ir->segments, table};
+    pool_run(pool, lexSegment, &job, count);
+
+    size_t length = 0, symbols = 0;
+    ir->orig = SIZE_MAX;
+    for (size_t s = 0; s < count; ++s){
+        ir_segment* segment = &ir->segments[s];
+        if (!segment->ok){
+            return false;
+        }
+        if (ir->orig == SIZE_MAX && segment->ir.orig < segment->ir.length){
+            ir->orig = length + segment->ir.orig;
+        }
+        segment->first = length;
+        segment->lines = ir->total;
+        length += segment->ir.length;
+        ir->total += segment->ir.total;
+        symbols += segment->label_count + segment->refs;
+    }
+    if (length > ir->capacity){
+        size_t new_capacity = ir->capacity * 2 > length ? ir->capacity * 2 : length;
+        ir_line* new_lines = realloc(ir->lines, new_capacity * sizeof(ir_line));
+        if (new_lines == NULL){
+            return false;
+        }
+        stats_count_alloc(1);
+        ir->lines = new_lines;
+        ir->capacity = new_capacity;
+    }
+    ir->length = length;
+    if (ir->orig == SIZE_MAX){
+        ir->orig = length;
+    }
+    input->pos = input->size;
+    input->line = ir->total;
+
+    // every label defined or referenced may be a new symbol, so that's the room the table needs
+    if (!symtab_share(table, symbols)){
+        return false;
+    }
+    pool_run(pool, joinSegment, &job, count);
+    bool ok = symtab_freeze(table);
+    for (size_t s = 0; s < count; ++s){
+        ok = ok && ir->segments[s].ok;
+    }
+    return ok;
+}
+
+void ir_operands(const asm_ir* ir, size_t index, token args[4]){
+    const ir_line* line = &ir->lines[index];
+    if (line->flags & IR_LONG_LINE){
+        token label, opcode;
+        ir_relex(ir, index, &label, &opcode, args);
+        return;
+    }
+    const char* start = ir->data + line->pos;
+    for (int i = 0; i < 4; ++i){
+        args[i].ptr = start + line->args[i].offset;
+        args[i].len = line->args[i].length;
+    }
+}
+
+void ir_relex(const asm_ir* ir, size_t index, token* label, token* opcode, token args[4]){
+    source input;
+    openBuffer(&input, ir->data, ir->size);
+    input.pos = ir->lines[index].pos;
+    int opcodeId;
+    readAndParse(&input, label, opcode, &args[0], &args[1], &args[2], &args[3], &opcodeId);
+}
@@ -0,0 +1,58 @@
+#include "isa.h"
+
+const isa_form* isa_decode(uint16_t word, int32_t values[4]){
+    for (size_t i = 0; i < isa_form_count; ++i){
+        const isa_form* form = &isa_forms[isa_decode_order[i]];
+        if ((word & form->mask) != (form->base & form->mask)){
+            continue;
+        }
+        int top[4] = {0};
+        for (int k = 0; k < 4; ++k){
+            values[k] = 0;
+        }
+        for (int k = 0; k < form->field_count; ++k){
+            const isa_field* field = &form->fields[k];
+            uint32_t mask = (1u << field->width) - 1;
+            uint32_t bits = (((uint32_t)word >> field->pos) - field->bias) & mask;
+            values[field->operand] |= (int32_t)(bits << field->shift);
+            if (field->shift + field->width > top[field->operand]){
+                top[field->operand] = field->shift + field->width;
+            }
+        }
+        // an operand that can be negative is sign extended from the highest bit any field holds
+        for (int k = 0; k < form->operand_count; ++k){
+            if (form->operands[k].is_signed && form->operands[k].min < 0 && top[k] > 0 && top[k] < 32){
+                int shift = 32 - top[k];
+                values[k] = (int32_t)((uint32_t)values[k] << shift) >> shift;
+            }
+        }
+        return form;
+    }
+    return NULL;
+}
+
+int isa_disassemble(uint16_t word, int address, char* text, size_t size){
+    int32_t values[4];
+    const isa_form* form = isa_decode(word, values);
+    if (form == NULL){
+        return snprintf(text, size, ".fill x%04x", word);
+    }
+    int length = snprintf(text, size, "%s", opcodeName(form->opcode));
+    for (int k = 0; k < form->operand_count; ++k){
+        char* end = (size_t)length < size ? text + length : NULL;
+        size_t room = end != NULL ? size - length : 0;
+        const char* separator = k > 0 ? ", " : " ";
+        switch (form->operands[k].kind){
+            case ISA_LABEL:
+                length += snprintf(end, room, "%sx%04x", separator, (address + 2 + 2 * values[k]) & 0xFFFF);
+                break;
+            case ISA_NUMBER:
+                length += snprintf(end, room, "%s#%d", separator, values[k]);
+                break;
+            default:
+                length += snprintf(end, room, "%sr%d", separator, values[k]);
+                break;
+        }
+    }
+    return length;
+}
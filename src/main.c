@@ -1,15 +1,195 @@
-#include "main.h"
-
-int main(){
-    char inputFilePath[64];
-    char outputFilePath[64]; 
-
-    obtainFilePath(inputFilePath, outputFilePath, 64);
-
-    printf("Entered input file path, max length 64: %s\n",inputFilePath);
-    printf("Entered output file path, max length 64: %s\n", outputFilePath);
-
-    assemble(inputFilePath,outputFilePath);
-    printf("Successfully assembled given program");
-    return 0;
+#include "main.h"
+
+/*
+Basic funcion used to get the file path from the user, just prompts
+and waits for input 2 times. One for input file, one for ouput file.
+ */
+void obtainFilePath(char* inputFile, char* outputFile, uint16_t maxSize){
+    printf("Enter the input file path:");
+    
+    if (fgets(inputFile, maxSize,stdin) != NULL){
+        size_t len = strlen(inputFile);
+        if (len > 0 && inputFile[len-1] == '\n'){
+            inputFile[len-1] = '\0';
+        }
+    }
+    printf("Enter the output file path:");
+    
+    if (fgets(outputFile, maxSize,stdin) != NULL){
+        size_t len = strlen(outputFile);
+        if (len > 0 && outputFile[len-1] == '\n'){
+            outputFile[len-1] = '\0';
+        }
+    }
+}
+
+//Inner function for checking the given files are valid
+void checkFiles(const char* inputFile, const char* outputFile, source* input, bool inputOpen,
+FILE** output, const char* outputMode){
+    if (!inputOpen){
+        // try without the true source
+        char tempStr[255];
+        tempStr[0] = '\0';
+        strcat(tempStr, "asmFiles/");
+        strcat(tempStr,inputFile);
+        if (!openSource(input, tempStr)){
+            printf("Cannot find file name %s, terminating...", inputFile);
+            exit(4);
+        }
+    }
+
+    if (*output == NULL){
+        // try without the true source
+        char tempStr[255];
+        tempStr[0] = '\0';
+        strcat(tempStr, "asmFiles/");
+        strcat(tempStr, outputFile);
+        *output = fopen(tempStr, outputMode);
+        if (*output == NULL){
+            printf("Cannot find file name %s, terminating...", outputFile);
+            exit(4);
+        }
+    }
+}
+
+
+/*
+Assembles the input file into the output file. The first error found is printed
+and we terminate with its code.
+*/
+void assemble(const char* inputFile,const char* outputFile, const asm_options* options){
+    const char* outputMode = isBinaryFormat(options->format) ? "r+b" : "r+";
+    source input;
+    bool inputOpen = openSource(&input, inputFile);
+    FILE *output = fopen(outputFile, outputMode);
+
+    checkFiles(inputFile, outputFile, &input, inputOpen, &output, outputMode);
+
+    // the image and its writing count towards the allocations too
+    stats_count_into(options->stats != NULL ? &options->stats->allocations : NULL);
+    diag_list diags;
+    diag_init(&diags);
+    image* img = image_create();
+    if (img == NULL){
+        diag_report(&diags, 4, "Out of memory, terminating...");
+    } else {
+        assembleSource(&input, options, img, &diags);
+    }
+    closeSource(&input);
+
+    if (diag_failed(&diags)){
+        int code = 4;
+        if (diags.length > 0){
+            code = diags.items[0].code;
+            printf("%s", diags.items[0].message);
+        } else {
+            printf("Out of memory, terminating...");
+        }
+        diag_free(&diags);
+        if (img != NULL){
+            image_destroy(img);
+        }
+        fclose(output);
+        exit(code);
+    }
+
+    double start = options->stats != NULL ? stats_now() : 0;
+    if (!writeImage(img, output, options->format)){
+        printf("Could not write output file %s, terminating...", outputFile);
+        exit(4);
+    }
+    if (options->stats != NULL){
+        options->stats->seconds[PHASE_OUTPUT] += stats_now() - start;
+        options->stats->lines[PHASE_OUTPUT] += image_size(img);
+        options->stats->bytes[PHASE_OUTPUT] += (size_t)ftell(output);
+    }
+    image_destroy(img);
+    fclose(output);
+    stats_count_into(NULL);
+}
+
+
+static void usage(void){
+    printf("Usage: assembler [--single-pass] [--format=hex|bin|obj|sobj] [--threads=N] [--stats[=text|json]]\n"
+        "    [--cache-dir=DIR] [--out-dir=DIR] [--serve[=PATH]] [input...]\n");
+}
+
+int main(int argc, char** argv){
+    char inputFilePath[64];
+    char outputFilePath[64]; 
+    asm_options options = {.passMode = TWO_PASS, .format = FORMAT_HEX};
+    asm_stats stats = {0};
+    const char* outDir = NULL;
+    const char* socketPath = NULL;
+    char defaultPath[SERVER_PATH_LENGTH];
+    int inputCount = 0;
+    int statsFormat = -1; // 0 for text, 1 for JSON, -1 for no stats
+
+    for (int i = 1; i < argc; ++i){
+        if (strncmp(argv[i], "--", 2) != 0){
+            // inputs are gathered at the front of argv for batch mode
+            argv[1 + inputCount++] = argv[i];
+        } else if (strncmp(argv[i], "--out-dir=", 10) == 0){
+            outDir = argv[i] + 10;
+        } else if (strcmp(argv[i], "--single-pass") == 0){
+            options.passMode = SINGLE_PASS;
+        } else if (strncmp(argv[i], "--format=", 9) == 0){
+            options.format = findFormat(argv[i] + 9);
+            if (options.format < 0){
+                printf("Unknown output format %s, expected hex, bin, obj or sobj\n", argv[i] + 9);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--threads=", 10) == 0){
+            options.threads = atoi(argv[i] + 10);
+            if (options.threads < 0){
+                printf("Invalid thread count %s\n", argv[i] + 10);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=text") == 0){
+            statsFormat = 0;
+        } else if (strcmp(argv[i], "--stats=json") == 0){
+            statsFormat = 1;
+        } else if (strncmp(argv[i], "--cache-dir=", 12) == 0){
+            options.cacheDir = argv[i] + 12;
+        } else if (strcmp(argv[i], "--serve") == 0){
+            defaultSocketPath(defaultPath, sizeof(defaultPath));
+            socketPath = defaultPath;
+        } else if (strncmp(argv[i], "--serve=", 8) == 0){
+            socketPath = argv[i] + 8;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (statsFormat >= 0){
+        options.stats = &stats;
+    }
+
+    if (socketPath != NULL){
+        int status = runServer(socketPath, &options);
+        if (statsFormat >= 0){
+            stats_print(&stats, stderr, statsFormat == 1);
+        }
+        return status;
+    }
+
+    if (inputCount > 0){
+        int status = runBatch(argv + 1, inputCount, &options, outDir);
+        if (statsFormat >= 0){
+            stats_print(&stats, stderr, statsFormat == 1);
+        }
+        return status;
+    }
+
+    obtainFilePath(inputFilePath, outputFilePath, 64);
+
+    printf("Entered input file path, max length 64: %s\n",inputFilePath);
+    printf("Entered output file path, max length 64: %s\n", outputFilePath);
+
+    assemble(inputFilePath,outputFilePath, &options);
+    if (statsFormat >= 0){
+        stats_print(&stats, stderr, statsFormat == 1);
+    }
+    printf("Successfully assembled given program");
+    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include "output.h"
+#include "stats.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define OUTPUT_X86 1
+#include <immintrin.h>
+#endif
+
+#define HEX_ROW(h) h"0" h"1" h"2" h"3" h"4" h"5" h"6" h"7" \
+                   h"8" h"9" h"a" h"b" h"c" h"d" h"e" h"f"
+
+// Two hex digits for every byte value, byte b lives at hexPairs[b*2]
+static const char hexPairs[] =
+    HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3")
+    HEX_ROW("4") HEX_ROW("5") HEX_ROW("6") HEX_ROW("7")
+    HEX_ROW("8") HEX_ROW("9") HEX_ROW("a") HEX_ROW("b")
+    HEX_ROW("c") HEX_ROW("d") HEX_ROW("e") HEX_ROW("f");
+
+#define HEX_LINE_LENGTH 7 // "0xNNNN\n"
+#define OUTPUT_BUFFER (256 * 1024) // bytes formatted between writes
+#define OUTPUT_SLACK 16 // the vector formatter stores a few bytes past the lines it writes
+#define SPARSE_ZEROS 0x8000 // set in the header word of a sparse object record of zeros
+#define SPARSE_RUN_MAX 0x7FFF // most words one record covers
+
+int findFormat(const char* name){
+    if (strcmp(name, "hex") == 0){
+        return FORMAT_HEX;
+    }
+    if (strcmp(name, "bin") == 0){
+        return FORMAT_BIN;
+    }
+    if (strcmp(name, "obj") == 0){
+        return FORMAT_OBJ;
+    }
+    if (strcmp(name, "sobj") == 0){
+        return FORMAT_SOBJ;
+    }
+    return -1;
+}
+
+const char* formatExtension(int format){
+    switch (format){
+        case FORMAT_BIN: return ".bin";
+        case FORMAT_OBJ: return ".obj";
+        case FORMAT_SOBJ: return ".sobj";
+        default: return ".hex";
+    }
+}
+
+bool isBinaryFormat(int format){
+    return format == FORMAT_BIN || format == FORMAT_OBJ || format == FORMAT_SOBJ;
+}
+
+// Format a word as "0xNNNN\n" at pOut
+static inline char* putHexLine(char* pOut, uint16_t word){
+    pOut[0] = '0';
+    pOut[1] = 'x';
+    memcpy(pOut + 2, &hexPairs[(word >> 8) * 2], 2);
+    memcpy(pOut + 4, &hexPairs[(word & 0xFF) * 2], 2);
+    pOut[6] = '\n';
+    return pOut + HEX_LINE_LENGTH;
+}
+
+// Store a word as two big-endian bytes at pOut
+static inline unsigned char* putWordBE(unsigned char* pOut, uint16_t word){
+    pOut[0] = (unsigned char)(word >> 8);
+    pOut[1] = (unsigned char)(word & 0xFF);
+    return pOut + 2;
+}
+
+// Format count words as hex lines at pOut, return the end of the text
+static char* putHexLines(char* pOut, const uint16_t* words, size_t count){
+    for (size_t i = 0; i < count; ++i){
+        pOut = putHexLine(pOut, words[i]);
+    }
+    return pOut;
+}
+
+#ifdef OUTPUT_X86
+/*
+Eight words at a time: their nibbles are split out in text order and looked up
+as digits with one shuffle, then two more shuffles per four words spread the
+digits over the lines with room for "0x" and the newline, which are OR'd in.
+Each group of four lines is stored as 32 bytes of which 28 are used.
+*/
+__attribute__((target("ssse3")))
+static char* putHexLinesSsse3(char* pOut, const uint16_t* words, size_t count){
+    const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+        '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    // digits of a word come out low byte first, the lines want its high byte first
+    const __m128i firstSpread = _mm_setr_epi8(-1, -1, 2, 3, 0, 1, -1, -1, -1, 6, 7, 4, 5, -1, -1, -1);
+    const __m128i firstFixed = _mm_setr_epi8('0', 'x', 0, 0, 0, 0, '\n', '0', 'x', 0, 0, 0, 0, '\n', '0', 'x');
+    const __m128i secondSpread = _mm_setr_epi8(10, 11, 8, 9, -1, -1, -1, 14, 15, 12, 13, -1, -1, -1, -1, -1);
+    const __m128i secondFixed = _mm_setr_epi8(0, 0, 0, 0, '\n', '0', 'x', 0, 0, 0, 0, '\n', 0, 0, 0, 0);
+    const __m128i lowNibble = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(words + i));
+        __m128i low = _mm_and_si128(bytes, lowNibble);
+        __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), lowNibble);
+        __m128i halves[2] = {
+            _mm_shuffle_epi8(digits, _mm_unpacklo_epi8(high, low)),
+            _mm_shuffle_epi8(digits, _mm_unpackhi_epi8(high, low))
+        };
+        for (int half = 0; half < 2; ++half){
+            __m128i first = _mm_or_si128(_mm_shuffle_epi8(halves[half], firstSpread), firstFixed);
+            __m128i second = _mm_or_si128(_mm_shuffle_epi8(halves[half], secondSpread), secondFixed);
+            _mm_storeu_si128((__m128i*)pOut, first);
+            _mm_storeu_si128((__m128i*)(pOut + 16), second);
+            pOut += 4 * HEX_LINE_LENGTH;
+        }
+    }
+    return putHexLines(pOut, words + i, count - i);
+}
+#endif
+
+// Output buffer, written out whenever the next lines don't fit in it
+typedef struct {
+    FILE* file;
+    int format;
+    char* buffer;
+    char* pOut;    // where the next byte goes
+    bool ok;       // every write so far went through
+    char* (*putLines)(char* pOut, const uint16_t* words, size_t count);
+} image_writer;
+
+static void flushOutput(image_writer* writer){
+    size_t size = (size_t)(writer->pOut - writer->buffer);
+    if (size > 0 && writer->ok){
+        writer->ok = fwrite(writer->buffer, 1, size, writer->file) == size;
+    }
+    writer->pOut = writer->buffer;
+}
+
+// Return the bytes free in the buffer, writing it out first if fewer than size are
+static size_t outputRoom(image_writer* writer, size_t size){
+    size_t room = (size_t)(writer->buffer + OUTPUT_BUFFER - writer->pOut);
+    if (room < size){
+        flushOutput(writer);
+        room = OUTPUT_BUFFER;
+    }
+    return room;
+}
+
+static void writeWords(image_writer* writer, const uint16_t* words, size_t count){
+    while (count > 0){
+        size_t part;
+        if (writer->format == FORMAT_HEX){
+            part = outputRoom(writer, HEX_LINE_LENGTH) / HEX_LINE_LENGTH;
+            part = part < count ? part : count;
+            writer->pOut = writer->putLines(writer->pOut, words, part);
+        } else {
+            // a sparse object has a record header before the words
+            bool sparse = writer->format == FORMAT_SOBJ;
+            part = outputRoom(writer, sparse ? 4 : 2) / 2 - sparse;
+            part = part < count ? part : count;
+            unsigned char* pBytes = (unsigned char*)writer->pOut;
+            if (sparse){
+                part = part < SPARSE_RUN_MAX ? part : SPARSE_RUN_MAX;
+                pBytes = putWordBE(pBytes, (uint16_t)part);
+            }
+            for (size_t i = 0; i < part; ++i){
+                pBytes = putWordBE(pBytes, words[i]);
+            }
+            writer->pOut = (char*)pBytes;
+        }
+        words += part;
+        count -= part;
+    }
+}
+
+// A region is a record of its own in a sparse object, the other formats get its zeros in bulk
+static void writeZeros(image_writer* writer, size_t count){
+    while (count > 0){
+        size_t part;
+        if (writer->format == FORMAT_SOBJ){
+            outputRoom(writer, 2);
+            part = count < SPARSE_RUN_MAX ? count : SPARSE_RUN_MAX;
+            writer->pOut = (char*)putWordBE((unsigned char*)writer->pOut, (uint16_t)(SPARSE_ZEROS | part));
+        } else if (writer->format == FORMAT_HEX){
+            part = outputRoom(writer, HEX_LINE_LENGTH) / HEX_LINE_LENGTH;
+            part = part < count ? part : count;
+            // one line, then copies of what is there already, doubling each time
+            size_t size = part * HEX_LINE_LENGTH;
+            size_t done = (size_t)(putHexLine(writer->pOut, 0) - writer->pOut);
+            while (done < size){
+                size_t copy = done < size - done ? done : size - done;
+                memcpy(writer->pOut + done, writer->pOut, copy);
+                done += copy;
+            }
+            writer->pOut += size;
+        } else {
+            part = outputRoom(writer, 2) / 2;
+            part = part < count ? part : count;
+            memset(writer->pOut, 0, part * 2);
+            writer->pOut += part * 2;
+        }
+        count -= part;
+    }
+}
+
+bool writeImage(image* img, FILE* output, int format){
+    char* buffer = malloc(OUTPUT_BUFFER + OUTPUT_SLACK);
+    if (buffer == NULL){
+        return false;
+    }
+    stats_count_alloc(1);
+
+    image_writer writer = {output, format, buffer, buffer, true, putHexLines};
+#ifdef OUTPUT_X86
+    if (__builtin_cpu_supports("ssse3")){
+        writer.putLines = putHexLinesSsse3;
+    }
+#endif
+    if (format == FORMAT_HEX){
+        writer.pOut = putHexLine(writer.pOut, img->orig);
+    } else if (format != FORMAT_BIN){
+        writer.pOut = (char*)putWordBE((unsigned char*)writer.pOut, img->orig);
+    }
+
+    // stored words up to each region, then the region
+    size_t done = 0;
+    for (size_t i = 0; i < img->region_count; ++i){
+        writeWords(&writer, img->words + done, img->regions[i].at - done);
+        writeZeros(&writer, img->regions[i].count);
+        done = img->regions[i].at;
+    }
+    writeWords(&writer, img->words + done, img->length - done);
+    flushOutput(&writer);
+    free(buffer);
+    return writer.ok;
+}
@@ -0,0 +1,160 @@
+#include "scan.h"
+#include <string.h>
+#include <stdatomic.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+typedef scan_mask (*scan_fn)(const char* text, size_t size);
+
+// Byte classes for the scalar kernel
+#define DELIMITER 1
+#define STOP 2
+
+static const uint8_t byte_class[256] = {
+    [' '] = DELIMITER, ['\t'] = DELIMITER, [','] = DELIMITER, ['\r'] = DELIMITER,
+    ['\n'] = DELIMITER | STOP, [';'] = STOP
+};
+
+// A block near the end of the text is copied out so the vector loads don't read past it
+static inline const char* pad_block(const char* text, size_t size, char* padded){
+    if (size >= SCAN_BLOCK){
+        return text;
+    }
+    memset(padded, 0, SCAN_BLOCK);
+    memcpy(padded, text, size);
+    return padded;
+}
+
+static inline scan_mask stop_at_end(scan_mask mask, size_t size){
+    if (size < SCAN_BLOCK){
+        mask.stops |= ~0ull << size;
+    }
+    return mask;
+}
+
+static scan_mask scan_scalar(const char* text, size_t size){
+    scan_mask mask = {0, 0};
+    size_t count = size < SCAN_BLOCK ? size : SCAN_BLOCK;
+    for (size_t i = 0; i < count; ++i){
+        uint8_t cls = byte_class[(unsigned char)text[i]];
+        mask.delimiters |= (uint64_t)(cls & DELIMITER) << i;
+        if (cls & STOP){ // nothing past it is looked at
+            mask.stops |= 1ull << i;
+            return mask;
+        }
+    }
+    return stop_at_end(mask, size);
+}
+
+#ifdef SCAN_X86
+// Four 16 byte compares per class, OR'd together
+__attribute__((target("sse2")))
+static scan_mask scan_sse2(const char* text, size_t size){
+    char padded[SCAN_BLOCK];
+    const char* block = pad_block(text, size, padded);
+    scan_mask mask = {0, 0};
+    for (int part = 0; part < SCAN_BLOCK / 16; ++part){
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(block + 16 * part));
+        __m128i newline = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'));
+        __m128i delimiter = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(',')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))));
+        __m128i stop = _mm_or_si128(newline, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(';')));
+        mask.delimiters |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(delimiter, newline)) << (16 * part);
+        mask.stops |= (uint64_t)(uint16_t)_mm_movemask_epi8(stop) << (16 * part);
+    }
+    return stop_at_end(mask, size);
+}
+
+/*
+The six bytes looked for all have different low nibbles, so one shuffle looks up
+the byte each input byte would have to be and one compare finds all of them.
+*/
+__attribute__((target("avx2")))
+static scan_mask scan_avx2(const char* text, size_t size){
+    char padded[SCAN_BLOCK];
+    const char* block = pad_block(text, size, padded);
+    const __m256i expected = _mm256_setr_epi8(
+        ' ', -128, -128, -128, -128, -128, -128, -128, -128, '\t', '\n', ';', ',', '\r', -128, -128,
+        ' ', -128, -128, -128, -128, -128, -128, -128, -128, '\t', '\n', ';', ',', '\r', -128, -128);
+    scan_mask mask = {0, 0};
+    for (int part = 0; part < SCAN_BLOCK / 32; ++part){
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(block + 32 * part));
+        __m256i lookup = _mm256_shuffle_epi8(expected, _mm256_and_si256(bytes, _mm256_set1_epi8(0x0F)));
+        uint32_t special = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, lookup));
+        uint32_t semicolon = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(';')));
+        uint32_t newline = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+        mask.delimiters |= (uint64_t)(special & ~semicolon) << (32 * part);
+        mask.stops |= (uint64_t)(semicolon | newline) << (32 * part);
+    }
+    return stop_at_end(mask, size);
+}
+#endif
+
+static const scan_fn kernels[NUM_SCANNERS] = {
+#ifdef SCAN_X86
+    scan_scalar, scan_sse2, scan_avx2
+#else
+    scan_scalar, NULL, NULL
+#endif
+};
+
+static const char* const kernel_names[NUM_SCANNERS] = {"scalar", "sse2", "avx2"};
+
+// Kernel in use, -1 until the first scan picks one. Every thread picks the same
+static _Atomic int chosen = -1;
+
+static bool supported(int kernel){
+    if (kernel < 0 || kernel >= NUM_SCANNERS || kernels[kernel] == NULL){
+        return false;
+    }
+#ifdef SCAN_X86
+    if (kernel == SCAN_SSE2){
+        return __builtin_cpu_supports("sse2");
+    }
+    if (kernel == SCAN_AVX2){
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return true;
+}
+
+int scan_kernel(void){
+    int kernel = atomic_load_explicit(&chosen, memory_order_relaxed);
+    if (kernel < 0){
+        kernel = NUM_SCANNERS - 1;
+        while (!supported(kernel)){
+            kernel--;
+        }
+        atomic_store_explicit(&chosen, kernel, memory_order_relaxed);
+    }
+    return kernel;
+}
+
+bool scan_use(int kernel){
+    if (!supported(kernel)){
+        return false;
+    }
+    atomic_store_explicit(&chosen, kernel, memory_order_relaxed);
+    return true;
+}
+
+const char* scan_kernel_name(int kernel){
+    return kernel >= 0 && kernel < NUM_SCANNERS ? kernel_names[kernel] : "unknown";
+}
+
+int scan_find_kernel(const char* name){
+    for (int kernel = 0; kernel < NUM_SCANNERS; ++kernel){
+        if (strcmp(name, kernel_names[kernel]) == 0){
+            return kernel;
+        }
+    }
+    return -1;
+}
+
+scan_mask scan_block(const char* text, size_t size){
+    return kernels[scan_kernel()](text, size);
+}
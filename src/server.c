@@ -0,0 +1,400 @@
+#include "server.h"
+#include "threadpool.h"
+#include <stdatomic.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Largest source a server accepts, anything bigger is answered with an error
+#define MAX_REQUEST_SIZE ((uint64_t)1 << 30)
+
+// Sent by the client, followed by size bytes of source for REQUEST_ASSEMBLE
+typedef struct {
+    char magic[4];     // "AHQ1"
+    uint32_t kind;     // REQUEST_ASSEMBLE or REQUEST_STOP
+    uint32_t passMode; // TWO_PASS or SINGLE_PASS
+    uint32_t reserved;
+    uint64_t size;     // bytes of source
+} request_header;
+
+// Sent by the server, followed by count diagnostics, length words and then the regions
+typedef struct {
+    char magic[4];    // "AHR2"
+    uint32_t count;   // diagnostics sent
+    uint32_t errors;  // errors reported, more than count if some were dropped
+    uint16_t orig;    // origin of the image
+    uint16_t reserved;
+    uint64_t length;  // words sent
+    uint64_t regions; // zero regions sent, their at counted from the first word sent
+} reply_header;
+
+static const char requestMagic[4] = {'A', 'H', 'Q', '1'};
+static const char replyMagic[4] = {'A', 'H', 'R', '2'};
+
+void defaultSocketPath(char* path, size_t size){
+#ifndef _WIN32
+    const char* runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir != NULL && runtimeDir[0] != '\0'){
+        snprintf(path, size, "%s/ahasm.sock", runtimeDir);
+    } else {
+        snprintf(path, size, "/tmp/ahasm-%u.sock", (unsigned)getuid());
+    }
+#else
+    snprintf(path, size, "ahasm.sock");
+#endif
+}
+
+#ifndef _WIN32
+
+// Read exactly size bytes, return false on end of file or error
+static bool readAll(int fd, void* data, size_t size){
+    char* pData = data;
+    while (size > 0){
+        ssize_t got = read(fd, pData, size);
+        if (got < 0 && errno == EINTR){
+            continue;
+        }
+        if (got <= 0){
+            return false;
+        }
+        pData += got;
+        size -= (size_t)got;
+    }
+    return true;
+}
+
+// Write exactly size bytes, return false on error
+static bool writeAll(int fd, const void* data, size_t size){
+    const char* pData = data;
+    while (size > 0){
+        ssize_t put = write(fd, pData, size);
+        if (put < 0 && errno == EINTR){
+            continue;
+        }
+        if (put <= 0){
+            return false;
+        }
+        pData += put;
+        size -= (size_t)put;
+    }
+    return true;
+}
+
+// Fill in a Unix socket address for path, return false if the path is too long
+static bool socketAddress(struct sockaddr_un* address, const char* path){
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)){
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+int connectServer(const char* path){
+    struct sockaddr_un address;
+    if (!socketAddress(&address, path)){
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0){
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void disconnectServer(int fd){
+    close(fd);
+}
+
+bool stopServer(int fd){
+    request_header request;
+    memset(&request, 0, sizeof(request));
+    memcpy(request.magic, requestMagic, sizeof(requestMagic));
+    request.kind = REQUEST_STOP;
+    return writeAll(fd, &request, sizeof(request));
+}
+
+bool remoteAssemble(int fd, const char* text, size_t size, int passMode, image* output, diag_list* diags){
+    request_header request;
+    memset(&request, 0, sizeof(request));
+    memcpy(request.magic, requestMagic, sizeof(requestMagic));
+    request.kind = REQUEST_ASSEMBLE;
+    request.passMode = (uint32_t)passMode;
+    request.size = size;
+
+    reply_header reply;
+    if (!writeAll(fd, &request, sizeof(request)) || !writeAll(fd, text, size)
+        || !readAll(fd, &reply, sizeof(reply)) || memcmp(reply.magic, replyMagic, sizeof(replyMagic)) != 0){
+        return diag_report(diags, 4, "Lost connection to the assembler server, terminating...");
+    }
+
+    for (uint32_t i = 0; i < reply.count; ++i){
+        diagnostic item;
+        if (!readAll(fd, &item, sizeof(item))){
+            return diag_report(diags, 4, "Lost connection to the assembler server, terminating...");
+        }
+        int line = diags->line;
+        diags->line = item.line;
+        diag_report(diags, item.code, "%.*s", DIAG_MESSAGE_LENGTH - 1, item.message);
+        diags->line = line;
+    }
+    if (reply.errors > reply.count && reply.count == 0){
+        diag_report(diags, 4, "Out of memory, terminating...");
+    }
+
+    if (!image_reserve(output, reply.length) || !image_reserve_regions(output, reply.regions)){
+        return diag_report(diags, 4, "Out of memory, terminating...");
+    }
+    image_region* regions = output->regions + output->region_count;
+    if (!readAll(fd, output->words + output->length, reply.length * sizeof(uint16_t))
+        || !readAll(fd, regions, reply.regions * sizeof(image_region))){
+        return diag_report(diags, 4, "Lost connection to the assembler server, terminating...");
+    }
+    for (uint64_t i = 0; i < reply.regions; ++i){
+        regions[i].at += output->length;
+        output->zeros += regions[i].count;
+    }
+    output->orig = reply.orig;
+    output->length += reply.length;
+    output->region_count += reply.regions;
+    return !diag_failed(diags);
+}
+
+// State shared by the connection handlers
+typedef struct {
+    int listenFd;
+    const char* path;
+    asm_options options;
+    atomic_bool stopping;
+    int threads;
+    asm_stats* stats; // one per thread, NULL if not collecting stats
+} server;
+
+// Buffers one handler keeps from one request to the next
+typedef struct {
+    asm_workspace* ws;
+    image* img;
+    char* text;
+    size_t capacity;
+} handler;
+
+// Wake every handler waiting in accept so it sees the server is stopping
+static void wakeHandlers(server* srv){
+    atomic_store(&srv->stopping, true);
+    for (int i = 0; i < srv->threads; ++i){
+        int fd = connectServer(srv->path);
+        if (fd >= 0){
+            close(fd);
+        }
+    }
+}
+
+// Send the diagnostics and, if there were no errors, the image
+static bool sendReply(int fd, const image* img, const diag_list* diags){
+    reply_header reply;
+    memset(&reply, 0, sizeof(reply));
+    memcpy(reply.magic, replyMagic, sizeof(replyMagic));
+    reply.count = (uint32_t)diags->length;
+    reply.errors = (uint32_t)diags->errors;
+    reply.orig = img->orig;
+    reply.length = diag_failed(diags) ? 0 : img->length;
+    reply.regions = diag_failed(diags) ? 0 : img->region_count;
+    return writeAll(fd, &reply, sizeof(reply))
+        && writeAll(fd, diags->items, diags->length * sizeof(diagnostic))
+        && writeAll(fd, img->words, reply.length * sizeof(uint16_t))
+        && writeAll(fd, img->regions, reply.regions * sizeof(image_region));
+}
+
+// Assemble one request and send the reply, return false if the connection is done
+static bool serveRequest(server* srv, handler* h, int fd, const request_header* request, int thread){
+    diag_list diags;
+    diag_init(&diags);
+    image_clear(h->img);
+
+    if (request->size > MAX_REQUEST_SIZE){
+        diag_report(&diags, 4, "Source of %llu bytes is too large, terminating...", (unsigned long long)request->size);
+    } else if (request->size > h->capacity){
+        char* text = realloc(h->text, request->size);
+        if (text == NULL){
+            diag_report(&diags, 4, "Out of memory, terminating...");
+        } else {
+            stats_count_alloc(1);
+            h->text = text;
+            h->capacity = request->size;
+        }
+    }
+    if (diag_failed(&diags)){
+        // the source can't be kept, so the connection can't be read any further
+        sendReply(fd, h->img, &diags);
+        diag_free(&diags);
+        return false;
+    }
+    if (!readAll(fd, h->text, request->size)){
+        return false;
+    }
+
+    asm_options options = srv->options;
+    options.passMode = request->passMode == SINGLE_PASS ? SINGLE_PASS : TWO_PASS;
+    options.stats = srv->stats != NULL ? &srv->stats[thread] : NULL;
+    source input;
+    openBuffer(&input, h->text, request->size);
+    assembleWith(h->ws, &input, &options, h->img, &diags);
+
+    bool ok = sendReply(fd, h->img, &diags);
+    diag_free(&diags);
+    return ok;
+}
+
+// Serve requests on one connection until the client hangs up or asks the server to stop
+static void serveConnection(server* srv, handler* h, int fd, int thread){
+    request_header request;
+    while (readAll(fd, &request, sizeof(request)) && memcmp(request.magic, requestMagic, sizeof(requestMagic)) == 0){
+        if (request.kind == REQUEST_STOP){
+            wakeHandlers(srv);
+            return;
+        }
+        if (request.kind != REQUEST_ASSEMBLE || !serveRequest(srv, h, fd, &request, thread)){
+            return;
+        }
+    }
+}
+
+// The task every pool thread runs for the life of the server, index is its slot in srv->stats
+static void handleConnections(void* arg, size_t index, int thread){
+    server* srv = arg;
+    (void)thread;
+    // allocations are counted along with the rest of the stats of the slot
+    size_t* outer = stats_count_into(srv->stats != NULL ? &srv->stats[index].allocations : NULL);
+    handler h = {asm_workspace_create(), image_create(), NULL, 0};
+    if (h.ws == NULL || h.img == NULL){
+        printf("Out of memory, handler %zu not started\n", index);
+    }
+    while (h.ws != NULL && h.img != NULL && !atomic_load(&srv->stopping)){
+        int fd = accept(srv->listenFd, NULL, NULL);
+        if (fd < 0){
+            if (errno == EINTR || errno == ECONNABORTED){
+                continue;
+            }
+            break;
+        }
+        if (!atomic_load(&srv->stopping)){
+            serveConnection(srv, &h, fd, (int)index);
+        }
+        close(fd);
+    }
+    if (h.ws != NULL){
+        asm_workspace_destroy(h.ws);
+    }
+    if (h.img != NULL){
+        image_destroy(h.img);
+    }
+    free(h.text);
+    stats_count_into(outer);
+}
+
+static const char* socketPath;
+
+// Remove the socket on Ctrl-C so the next server can bind it
+static void onSignal(int sig){
+    unlink(socketPath);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+int runServer(const char* path, const asm_options* options){
+    struct sockaddr_un address;
+    if (!socketAddress(&address, path)){
+        printf("Socket path %s is too long\n", path);
+        return 1;
+    }
+    // a socket file nobody answers on is left over from a server that died, replace it
+    int running = connectServer(path);
+    if (running >= 0){
+        close(running);
+        printf("A server is already listening on %s\n", path);
+        return 1;
+    }
+    unlink(path);
+
+    server srv;
+    srv.path = path;
+    srv.options = *options;
+    srv.options.threads = 1; // the connections are what runs in parallel
+    srv.options.stats = NULL;
+    atomic_init(&srv.stopping, false);
+    srv.listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (srv.listenFd < 0 || bind(srv.listenFd, (struct sockaddr*)&address, sizeof(address)) != 0
+        || listen(srv.listenFd, SOMAXCONN) != 0){
+        printf("Cannot listen on %s: %s\n", path, strerror(errno));
+        if (srv.listenFd >= 0){
+            close(srv.listenFd);
+        }
+        return 1;
+    }
+    socketPath = path;
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN); // a client hanging up mid reply only ends its connection
+
+    int threads = options->threads > 0 ? options->threads : cpu_count();
+    threadpool* pool = threads > 1 ? pool_create(threads) : NULL;
+    srv.threads = pool_size(pool);
+    srv.stats = options->stats != NULL ? calloc(srv.threads, sizeof(asm_stats)) : NULL;
+    printf("Listening on %s with %d thread%s\n", path, srv.threads, srv.threads == 1 ? "" : "s");
+    fflush(stdout);
+
+    pool_run(pool, handleConnections, &srv, (size_t)srv.threads);
+    pool_destroy(pool);
+
+    if (srv.stats != NULL){
+        for (int i = 0; i < srv.threads; ++i){
+            stats_add(options->stats, &srv.stats[i]);
+        }
+        free(srv.stats);
+    }
+    close(srv.listenFd);
+    unlink(path);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    printf("Server on %s stopped\n", path);
+    return 0;
+}
+
+#else
+
+int connectServer(const char* path){
+    (void)path;
+    return -1;
+}
+
+void disconnectServer(int fd){
+    (void)fd;
+}
+
+bool stopServer(int fd){
+    (void)fd;
+    return false;
+}
+
+bool remoteAssemble(int fd, const char* text, size_t size, int passMode, image* output, diag_list* diags){
+    (void)fd; (void)text; (void)size; (void)passMode; (void)output;
+    return diag_report(diags, 4, "The assembler server needs Unix sockets, terminating...");
+}
+
+int runServer(const char* path, const asm_options* options){
+    (void)path; (void)options;
+    printf("The assembler server needs Unix sockets\n");
+    return 1;
+}
+
+#endif
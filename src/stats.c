@@ -0,0 +1,134 @@
+#include "stats.h"
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// Counter allocations on this thread go to, set while assembling with stats
+static _Thread_local size_t* allocations;
+
+const char* phaseName(int phase){
+    switch (phase){
+        case PHASE_LEX: return "lex";
+        case PHASE_FIND_ORIG: return "findOrig";
+        case PHASE_FIRST_PASS: return "firstPass";
+        case PHASE_SECOND_PASS: return "secondPass";
+        case PHASE_OUTPUT: return "output";
+        default: return "unknown";
+    }
+}
+
+double stats_now(void){
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void stats_add(asm_stats* dst, const asm_stats* src){
+    for (int phase = 0; phase < NUM_PHASES; ++phase){
+        dst->seconds[phase] += src->seconds[phase];
+        dst->lines[phase] += src->lines[phase];
+        dst->bytes[phase] += src->bytes[phase];
+    }
+    // mean probe is weighted by the labels of each side
+    size_t labels = dst->labels.length + src->labels.length;
+    if (labels > 0){
+        dst->labels.mean_probe = (dst->labels.mean_probe * dst->labels.length
+            + src->labels.mean_probe * src->labels.length) / labels;
+    }
+    dst->labels.length = labels;
+    dst->labels.expansions += src->labels.expansions;
+    dst->labels.collisions += src->labels.collisions;
+    for (int i = 0; i < HT_PROBE_BUCKETS; ++i){
+        dst->labels.probes[i] += src->labels.probes[i];
+    }
+    if (src->labels.capacity > dst->labels.capacity){
+        dst->labels.capacity = src->labels.capacity;
+    }
+    if (src->labels.max_probe > dst->labels.max_probe){
+        dst->labels.max_probe = src->labels.max_probe;
+    }
+    dst->assemblies += src->assemblies;
+    dst->cacheHits += src->cacheHits;
+    dst->allocations += src->allocations;
+}
+
+void stats_count_alloc(size_t count){
+    if (allocations != NULL){
+        *allocations += count;
+    }
+}
+
+size_t* stats_count_into(size_t* counter){
+    size_t* previous = allocations;
+    allocations = counter;
+    return previous;
+}
+
+size_t* stats_counter(void){
+    return allocations;
+}
+
+size_t stats_peak_rss(void){
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0){
+        return 0;
+    }
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss; // bytes on macOS
+#else
+    return (size_t)usage.ru_maxrss * 1024; // kilobytes everywhere else
+#endif
+#else
+    return 0;
+#endif
+}
+
+// Return seconds, or a tiny value so rates don't divide by zero
+static double nonZero(double seconds){
+    return seconds > 0 ? seconds : 1e-9;
+}
+
+void stats_print(const asm_stats* stats, FILE* output, bool json){
+    size_t rss = stats_peak_rss();
+    const ht_stats* labels = &stats->labels;
+    if (json){
+        fprintf(output, "{\"assemblies\":%zu,\"cacheHits\":%zu,\"phases\":{", stats->assemblies, stats->cacheHits);
+        for (int phase = 0; phase < NUM_PHASES; ++phase){
+            fprintf(output, "%s\"%s\":{\"seconds\":%.6f,\"lines\":%zu,\"bytes\":%zu}", phase > 0 ? "," : "",
+                phaseName(phase), stats->seconds[phase], stats->lines[phase], stats->bytes[phase]);
+        }
+        fprintf(output, "},\"labels\":{\"length\":%zu,\"capacity\":%zu,\"expansions\":%zu,\"collisions\":%zu,\"maxProbe\":%zu,\"meanProbe\":%.3f,\"probes\":[",
+            labels->length, labels->capacity, labels->expansions, labels->collisions, labels->max_probe, labels->mean_probe);
+        for (int i = 0; i < HT_PROBE_BUCKETS; ++i){
+            fprintf(output, "%s%zu", i > 0 ? "," : "", labels->probes[i]);
+        }
+        fprintf(output, "]},");
+        fprintf(output, "\"allocations\":%zu,\"peakRss\":%zu}\n", stats->allocations, rss);
+        return;
+    }
+
+    if (stats->cacheHits > 0){
+        fprintf(output, "%zu of %zu assemblies came from the cache\n", stats->cacheHits, stats->assemblies);
+    }
+    fprintf(output, "%-12s %10s %10s %14s %10s\n", "phase", "ms", "lines", "lines/s", "MB/s");
+    for (int phase = 0; phase < NUM_PHASES; ++phase){
+        double seconds = nonZero(stats->seconds[phase]);
+        fprintf(output, "%-12s %10.3f %10zu %14.0f %10.1f\n", phaseName(phase), stats->seconds[phase] * 1000,
+            stats->lines[phase], stats->lines[phase] / seconds, stats->bytes[phase] / seconds / 1e6);
+    }
+    fprintf(output, "labels: %zu in %zu slots, %zu expansions, %zu collisions, probe length max %zu mean %.2f\n",
+        labels->length, labels->capacity, labels->expansions, labels->collisions, labels->max_probe, labels->mean_probe);
+    fprintf(output, "probe lengths:");
+    for (int i = 0; i < HT_PROBE_BUCKETS; ++i){
+        fprintf(output, " %d%s:%zu", i + 1, i == HT_PROBE_BUCKETS - 1 ? "+" : "", labels->probes[i]);
+    }
+    fputc('\n', output);
+    fprintf(output, "allocations: %zu, peak RSS: %.1f MB\n", stats->allocations, rss / 1e6);
+}
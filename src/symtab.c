@@ -0,0 +1,368 @@
+#include "symtab.h"
+#include "ht.h"
+#include "stats.h"
+#include "string.h"
+#include <stdatomic.h>
+
+// Lowercase an ASCII character, keys are compared ignoring case
+#define FOLD(c) (((c) >= 'A' && (c) <= 'Z') ? ((c) | 0x20) : (c))
+
+/*
+A slot of the table. A slot is taken once its hash is set, the key is stored last
+so a thread that sees it also sees the length and id. Keys interned by
+symtab_intern_shared point at the caller's text until symtab_freeze copies them.
+*/
+typedef struct {
+    _Atomic uint64_t hash;     // hash of the key, never 0, 0 if this slot is empty
+    _Atomic(const char*) key;  // lowercase copy of the key, NULL until the slot is filled in
+    uint32_t length;           // length of the key
+    uint32_t id;               // index of the symbol in symtab.symbols
+} sym_entry;
+
+#define LOAD(x) atomic_load_explicit(&(x), memory_order_relaxed)
+#define STORE(x, v) atomic_store_explicit(&(x), (v), memory_order_relaxed)
+
+// Set in symtab.symbols once a symbol has its address
+#define SYMBOL_DEFINED 0x10000u
+
+struct symtab {
+    sym_entry* entries; // hash slots
+    size_t capacity;    // size of entries array, a power of 2
+    size_t length;      // number of symbols in table
+    size_t limit;       // length at which the table expands
+    double max_load;    // fraction of slots used before expanding
+    size_t expansions;  // times the slots were doubled because the table filled up
+    arena* keys;        // owns the key copies
+    _Atomic uint32_t* symbols; // address of every symbol by id, or'ed with SYMBOL_DEFINED
+    size_t symbols_capacity; // size of symbols array
+    size_t shared_from;           // first id interned by symtab_intern_shared
+    size_t shared_limit;          // slots symtab_intern_shared may take in total
+    atomic_size_t shared_length;  // symbols once symtab_intern_shared is done
+    atomic_size_t shared_claimed; // slots taken or about to be by symtab_intern_shared
+};
+
+#define INITIAL_CAPACITY 64
+#define DEFAULT_MAX_LOAD 0.5
+
+symtab* symtab_create(arena* keys){
+    symtab* table = malloc(sizeof(symtab));
+    if (table == NULL){
+        return NULL;
+    }
+    table->length = 0;
+    table->expansions = 0;
+    table->capacity = INITIAL_CAPACITY;
+    table->max_load = DEFAULT_MAX_LOAD;
+    table->limit = (size_t)(table->capacity * table->max_load);
+    table->keys = keys;
+    table->symbols_capacity = table->limit;
+    table->entries = calloc(table->capacity, sizeof(sym_entry));
+    table->symbols = malloc(table->symbols_capacity * sizeof(uint32_t));
+    if (table->entries == NULL || table->symbols == NULL){
+        free(table->entries);
+        free((void*)table->symbols);
+        free(table);
+        return NULL;
+    }
+    stats_count_alloc(3);
+    return table;
+}
+
+void symtab_destroy(symtab* table){
+    free(table->entries);
+    free((void*)table->symbols);
+    free(table);
+}
+
+void symtab_clear(symtab* table){
+    if (table->length > 0){
+        memset(table->entries, 0, table->capacity * sizeof(sym_entry));
+        table->length = 0;
+    }
+}
+
+// Return the hash of key, never 0 as that marks an empty slot
+static inline uint64_t key_hash(const char* key, size_t length){
+    uint64_t hash = ht_hash(key, length);
+    return hash != 0 ? hash : 1;
+}
+
+// Return true if the two keys are the same ignoring case, either may be a shared key that isn't lowercase
+static inline bool keys_equal(const char* a, const char* b, size_t length){
+    for (size_t i = 0; i < length; i++){
+        if (FOLD(a[i]) != FOLD(b[i])){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Return true if the slot holds the given key, cheap checks first. A slot still
+// being filled in by symtab_intern_shared doesn't match yet.
+static inline bool entry_matches(sym_entry* entry, uint64_t hash, const char* key, size_t length){
+    if (LOAD(entry->hash) != hash){
+        return false;
+    }
+    const char* stored = atomic_load_explicit(&entry->key, memory_order_acquire);
+    return stored != NULL && entry->length == length && keys_equal(stored, key, length);
+}
+
+// Return the slot holding key, or the empty slot it would go in
+static sym_entry* find_slot(sym_entry* entries, size_t capacity, uint64_t hash, const char* key, size_t length){
+    size_t index = (size_t)(hash & (uint64_t)(capacity - 1));
+    while (LOAD(entries[index].hash) != 0 && !entry_matches(&entries[index], hash, key, length)){
+        index = (index + 1) & (capacity - 1);
+    }
+    return &entries[index];
+}
+
+bool symtab_get(symtab* table, const char* key, size_t length, uint16_t* address){
+    uint64_t hash = key_hash(key, length);
+    sym_entry* entry = find_slot(table->entries, table->capacity, hash, key, length);
+    // check again, symtab_intern_shared may have taken the empty slot the probe ended on
+    return entry_matches(entry, hash, key, length) && symtab_address(table, (int32_t)entry->id, address);
+}
+
+bool symtab_address(symtab* table, int32_t id, uint16_t* address){
+    uint32_t symbol = atomic_load_explicit(&table->symbols[id], memory_order_relaxed);
+    *address = (uint16_t)symbol;
+    return (symbol & SYMBOL_DEFINED) != 0;
+}
+
+// Move the symbols to a slot array of new_capacity, the cached hashes mean keys
+// don't need rehashing
+static bool symtab_resize(symtab* table, size_t new_capacity){
+    sym_entry* new_entries = calloc(new_capacity, sizeof(sym_entry));
+    if (new_entries == NULL){
+        return false;
+    }
+    for (size_t i = 0; i < table->capacity; i++){
+        sym_entry* entry = &table->entries[i];
+        uint64_t hash = LOAD(entry->hash);
+        if (hash != 0){
+            size_t index = (size_t)(hash & (uint64_t)(new_capacity - 1));
+            while (LOAD(new_entries[index].hash) != 0){
+                index = (index + 1) & (new_capacity - 1);
+            }
+            STORE(new_entries[index].hash, hash);
+            STORE(new_entries[index].key, LOAD(entry->key));
+            new_entries[index].length = entry->length;
+            new_entries[index].id = entry->id;
+        }
+    }
+    free(table->entries);
+    table->entries = new_entries;
+    table->capacity = new_capacity;
+    table->limit = (size_t)(new_capacity * table->max_load);
+    stats_count_alloc(1);
+    return true;
+}
+
+// Double the slot array
+static bool symtab_expand(symtab* table){
+    size_t new_capacity = table->capacity * 2;
+    if (new_capacity < table->capacity){
+        return false; // overflow (capacity would be too big)
+    }
+    if (!symtab_resize(table, new_capacity)){
+        return false;
+    }
+    table->expansions++;
+    return true;
+}
+
+// Make room for count symbols in the symbols array
+static bool symtab_reserve_symbols(symtab* table, size_t count){
+    if (count <= table->symbols_capacity){
+        return true;
+    }
+    size_t new_capacity = table->symbols_capacity * 2 > count ? table->symbols_capacity * 2 : count;
+    _Atomic uint32_t* new_symbols = realloc((void*)table->symbols, new_capacity * sizeof(uint32_t));
+    if (new_symbols == NULL){
+        return false;
+    }
+    stats_count_alloc(1);
+    table->symbols = new_symbols;
+    table->symbols_capacity = new_capacity;
+    return true;
+}
+
+bool symtab_reserve(symtab* table, size_t expected){
+    if (!symtab_reserve_symbols(table, expected)){
+        return false;
+    }
+    size_t new_capacity = table->capacity;
+    while (new_capacity * table->max_load <= expected){
+        if (new_capacity * 2 < new_capacity){
+            return false;
+        }
+        new_capacity *= 2;
+    }
+    return new_capacity == table->capacity || symtab_resize(table, new_capacity);
+}
+
+void symtab_set_max_load(symtab* table, double load){
+    table->max_load = load < 0.1 ? 0.1 : (load > 0.9 ? 0.9 : load);
+    table->limit = (size_t)(table->capacity * table->max_load);
+}
+
+int32_t symtab_intern(symtab* table, const char* key, size_t length){
+    //if length will exceed the max load of current capacity, expand it
+    if (table->length >= table->limit && !symtab_expand(table)){
+        return -1;
+    }
+
+    uint64_t hash = key_hash(key, length);
+    sym_entry* entry = find_slot(table->entries, table->capacity, hash, key, length);
+    if (LOAD(entry->hash) != 0){
+        return (int32_t)entry->id;
+    }
+    if (table->length >= INT32_MAX || !symtab_reserve_symbols(table, table->length + 1)){
+        return -1;
+    }
+
+    char* copy = arena_alloc(table->keys, length + 1);
+    if (copy == NULL){
+        return -1;
+    }
+    for (size_t i = 0; i < length; i++){
+        copy[i] = FOLD(key[i]);
+    }
+    copy[length] = '\0';
+
+    STORE(entry->hash, hash);
+    STORE(entry->key, copy);
+    entry->length = (uint32_t)length;
+    entry->id = (uint32_t)table->length;
+    atomic_store_explicit(&table->symbols[entry->id], 0, memory_order_relaxed);
+    table->length++;
+    return (int32_t)entry->id;
+}
+
+bool symtab_share(symtab* table, size_t expected){
+    if (!symtab_reserve(table, table->length + expected)){
+        return false;
+    }
+    table->shared_from = table->length;
+    table->shared_limit = table->limit < table->symbols_capacity ? table->limit : table->symbols_capacity;
+    atomic_store(&table->shared_length, table->length);
+    atomic_store(&table->shared_claimed, table->length);
+    return true;
+}
+
+int32_t symtab_intern_shared(symtab* table, const char* key, size_t length){
+    uint64_t hash = key_hash(key, length);
+    size_t mask = table->capacity - 1;
+    size_t index = (size_t)(hash & (uint64_t)mask);
+    for (;;){
+        sym_entry* entry = &table->entries[index];
+        uint64_t slot = atomic_load_explicit(&entry->hash, memory_order_acquire);
+        if (slot == 0){
+            // count the slot before taking it, so the table never fills up
+            if (atomic_fetch_add(&table->shared_claimed, 1) >= table->shared_limit){
+                atomic_fetch_sub(&table->shared_claimed, 1);
+                // claims of threads that lost a slot are given back in a moment, and the slot
+                // may have been taken by this very key meanwhile, so only fail once the room
+                // is really used up and the slot is still empty
+                if (atomic_load(&table->shared_length) >= table->shared_limit && atomic_load(&entry->hash) == 0){
+                    return -1;
+                }
+                continue;
+            }
+            if (!atomic_compare_exchange_strong(&entry->hash, &slot, hash)){
+                // another thread took it first, look at what it put there
+                atomic_fetch_sub(&table->shared_claimed, 1);
+                continue;
+            }
+            uint32_t id = (uint32_t)atomic_fetch_add(&table->shared_length, 1);
+            STORE(table->symbols[id], 0);
+            entry->length = (uint32_t)length;
+            entry->id = id;
+            atomic_store_explicit(&entry->key, key, memory_order_release);
+            return (int32_t)id;
+        }
+        if (slot == hash){
+            // the thread that took the slot may still be filling it in
+            const char* stored;
+            while ((stored = atomic_load_explicit(&entry->key, memory_order_acquire)) == NULL){
+            }
+            if (entry->length == length && keys_equal(stored, key, length)){
+                return (int32_t)entry->id;
+            }
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+bool symtab_freeze(symtab* table){
+    table->length = atomic_load(&table->shared_length);
+    for (size_t i = 0; i < table->capacity; i++){
+        sym_entry* entry = &table->entries[i];
+        if (LOAD(entry->hash) != 0 && entry->id >= table->shared_from){
+            const char* key = LOAD(entry->key);
+            char* copy = arena_alloc(table->keys, entry->length + 1);
+            if (copy == NULL){
+                return false;
+            }
+            for (size_t k = 0; k < entry->length; k++){
+                copy[k] = FOLD(key[k]);
+            }
+            copy[entry->length] = '\0';
+            STORE(entry->key, copy);
+        }
+    }
+    table->shared_from = table->length;
+    return true;
+}
+
+int symtab_define(symtab* table, int32_t id, uint16_t address){
+    // compare and swap so only one of several threads defining the same symbol wins
+    uint32_t expected = atomic_load_explicit(&table->symbols[id], memory_order_relaxed);
+    while (!(expected & SYMBOL_DEFINED)){
+        if (atomic_compare_exchange_weak_explicit(&table->symbols[id], &expected, address | SYMBOL_DEFINED,
+            memory_order_relaxed, memory_order_relaxed)){
+            return SYM_ADDED;
+        }
+    }
+    return SYM_EXISTS;
+}
+
+void symtab_undefine(symtab* table){
+    for (size_t i = 0; i < table->length; i++){
+        atomic_store_explicit(&table->symbols[i], 0, memory_order_relaxed);
+    }
+}
+
+int symtab_add(symtab* table, const char* key, size_t length, uint16_t address){
+    int32_t id = symtab_intern(table, key, length);
+    if (id < 0){
+        return SYM_NO_MEMORY;
+    }
+    return symtab_define(table, id, address);
+}
+
+size_t symtab_length(symtab* table){
+    return table->length;
+}
+
+void symtab_info(symtab* table, ht_stats* stats){
+    memset(stats, 0, sizeof(ht_stats));
+    size_t total = 0;
+    for (size_t i = 0; i < table->capacity; i++){
+        sym_entry* entry = &table->entries[i];
+        uint64_t hash = LOAD(entry->hash);
+        if (hash != 0){
+            // a lookup reads every slot from the home slot up to this one
+            size_t home = (size_t)(hash & (uint64_t)(table->capacity - 1));
+            size_t probe = ((i - home) & (table->capacity - 1)) + 1;
+            total += probe;
+            stats->collisions += probe > 1;
+            stats->max_probe = probe > stats->max_probe ? probe : stats->max_probe;
+            stats->probes[probe < HT_PROBE_BUCKETS ? probe - 1 : HT_PROBE_BUCKETS - 1]++;
+        }
+    }
+    stats->length = table->length;
+    stats->capacity = table->capacity;
+    stats->expansions = table->expansions;
+    stats->mean_probe = table->length > 0 ? (double)total / table->length : 0;
+}
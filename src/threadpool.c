@@ -0,0 +1,172 @@
+#include "threadpool.h"
+#include "stats.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Worker thread argument
+typedef struct {
+    threadpool* pool;
+    int thread;         // index passed to tasks, the pool_run caller is 0
+    size_t allocations; // made by its tasks in the current batch, counted for the pool_run caller
+} worker;
+
+struct threadpool {
+    pthread_t* threads;       // worker threads, the pool_run caller is not in here
+    worker* args;             // argument of every worker thread
+    int workers;              // number of worker threads
+    pthread_mutex_t lock;
+    pthread_cond_t work;      // signalled when a batch is posted or the pool shuts down
+    pthread_cond_t done;      // signalled when the last worker leaves a batch
+    pool_task task;           // current batch
+    void* arg;
+    size_t count;
+    atomic_size_t next;       // next task index to hand out
+    unsigned long generation; // bumped for every batch
+    int busy;                 // workers that haven't finished the current batch
+    bool counting;            // the pool_run caller counts allocations, so the workers count theirs
+    bool shutdown;
+};
+
+int cpu_count(void){
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+}
+
+// Run tasks of the current batch until none are left
+static void run_tasks(threadpool* pool, int thread){
+    size_t index;
+    while ((index = atomic_fetch_add(&pool->next, 1)) < pool->count){
+        pool->task(pool->arg, index, thread);
+    }
+}
+
+static void* worker_main(void* arg){
+    worker* self = arg;
+    threadpool* pool = self->pool;
+    int thread = self->thread;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;){
+        while (!pool->shutdown && pool->generation == seen){
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (pool->shutdown){
+            break;
+        }
+        seen = pool->generation;
+        stats_count_into(pool->counting ? &self->allocations : NULL);
+        pthread_mutex_unlock(&pool->lock);
+
+        run_tasks(pool, thread);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0){
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+threadpool* pool_create(int threads){
+    threadpool* pool = calloc(1, sizeof(threadpool));
+    if (pool == NULL){
+        return NULL;
+    }
+    int workers = threads > 1 ? threads - 1 : 0;
+    pool->threads = calloc(workers > 0 ? workers : 1, sizeof(pthread_t));
+    pool->args = calloc(workers > 0 ? workers : 1, sizeof(worker));
+    if (pool->threads == NULL || pool->args == NULL){
+        free(pool->threads);
+        free(pool->args);
+        free(pool);
+        return NULL;
+    }
+    stats_count_alloc(3);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    atomic_init(&pool->next, 0);
+
+    for (int i = 0; i < workers; ++i){
+        pool->args[i].pool = pool;
+        pool->args[i].thread = i + 1;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, &pool->args[i]) != 0){
+            pool_destroy(pool);
+            return NULL;
+        }
+        pool->workers++;
+    }
+    return pool;
+}
+
+void pool_destroy(threadpool* pool){
+    if (pool == NULL){
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->workers; ++i){
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool->args);
+    free(pool);
+}
+
+int pool_size(threadpool* pool){
+    return pool == NULL ? 1 : pool->workers + 1;
+}
+
+void pool_run(threadpool* pool, pool_task task, void* arg, size_t count){
+    if (pool == NULL || pool->workers == 0 || count <= 1){
+        for (size_t i = 0; i < count; ++i){
+            task(arg, i, 0);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->arg = arg;
+    pool->count = count;
+    atomic_store(&pool->next, 0);
+    pool->busy = pool->workers;
+    pool->counting = stats_counter() != NULL;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_tasks(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0){
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    for (int i = 0; pool->counting && i < pool->workers; ++i){
+        stats_count_alloc(pool->args[i].allocations);
+        pool->args[i].allocations = 0;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,235 @@
+/*
+Document tests: random line edits of a small program, after each of which the image
+of the document has to match assembleBuffer of its text, or report the same first
+error. Edits that break the program are undone, so most of them land on one that
+assembles. Exits 1 on the first mismatch.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "assembler.h"
+
+#define EDITS 600
+#define MAX_LINES 512
+#define MAX_WORDS 8192
+
+#define CHECK(cond) do { \
+    if (!(cond)){ \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        return false; \
+    } \
+} while (0)
+
+static const char* const program[] = {
+    "        .ORIG x3000",
+    "START   LEA R0, MSG",
+    "        BRz DONE",
+    "LOOP    ADD R1, R1, #1",
+    "        LDW R2, R0, #2",
+    "        BRp LOOP",
+    "        JSR SUB",
+    "        LDI R3, PTR ; comment",
+    "        .BLKW #3",
+    "TABLE   .BLKW #20",
+    "        STI R3, PTR",
+    "SUB     AND R4, R4, #0",
+    "        RET",
+    "PTR     .FILL x4000",
+    "MSG     .STRINGZ hello",
+    "DONE    HALT",
+    "        .END",
+};
+
+// Lines edits insert, "%d" gets a label no other line has
+static const char* const inserts[] = {
+    "",
+    "; just a comment",
+    "        ADD R1, R1, #1",
+    "        BR LOOP",
+    "        BRnz DONE",
+    "        LEA R5, TABLE",
+    "        .BLKW #2",
+    "        .BLKW #17",
+    "        .FILL x1234",
+    "        .STRINGZ abc",
+    "L%d     ADD R0, R0, #0",
+    "L%d     .BLKW #40",
+    "        XOR R2, R3, R4",
+};
+
+static char* lines[MAX_LINES];
+static size_t lineCount;
+static unsigned seed = 1;
+static int nextLabel;
+
+static unsigned randomBelow(unsigned n){
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+static char* copyLine(const char* text){
+    char* copy = malloc(strlen(text) + 1);
+    if (copy != NULL){
+        strcpy(copy, text);
+    }
+    return copy;
+}
+
+// Join lines, each followed by '\n', into text and return its size
+static size_t joinLines(char** text, char* const* from, size_t count, bool lastNewline){
+    size_t size = 0;
+    for (size_t i = 0; i < count; ++i){
+        size += strlen(from[i]) + 1;
+    }
+    *text = malloc(size + 1);
+    char* pOut = *text;
+    for (size_t i = 0; pOut != NULL && i < count; ++i){
+        size_t length = strlen(from[i]);
+        memcpy(pOut, from[i], length);
+        pOut[length] = '\n';
+        pOut += length + 1;
+    }
+    return count > 0 && !lastNewline ? size - 1 : size;
+}
+
+// Write the words of img, zeros of the regions included, to words and return how many
+static size_t expand(const image* img, uint16_t* words){
+    size_t count = 0, done = 0;
+    for (size_t i = 0; i <= img->region_count; ++i){
+        size_t at = i < img->region_count ? img->regions[i].at : img->length;
+        memcpy(words + count, img->words + done, (at - done) * sizeof(uint16_t));
+        count += at - done;
+        done = at;
+        if (i < img->region_count){
+            memset(words + count, 0, img->regions[i].count * sizeof(uint16_t));
+            count += img->regions[i].count;
+        }
+    }
+    return count;
+}
+
+/*
+Replace removed lines from first with inserted in both the document and the lines,
+compare the document's image with a full assembly and set ok to whether it assembled.
+*/
+static bool edit(asm_document* doc, const asm_options* options, size_t first, size_t removed, char** inserted,
+size_t count, bool* ok){
+    CHECK(lineCount - removed + count <= MAX_LINES);
+    char* text;
+    // the last line only needs its '\n' if it is empty
+    size_t size = joinLines(&text, inserted, count, count == 0 || inserted[count - 1][0] == '\0' || randomBelow(2) == 0);
+    CHECK(text != NULL);
+    for (size_t i = first; i < first + removed; ++i){
+        free(lines[i]);
+    }
+    memmove(lines + first + count, lines + first + removed, (lineCount - first - removed) * sizeof(char*));
+    for (size_t i = 0; i < count; ++i){
+        lines[first + i] = copyLine(inserted[i]);
+        CHECK(lines[first + i] != NULL);
+    }
+    lineCount += count - removed;
+
+    image* edited = image_create();
+    image* full = image_create();
+    CHECK(edited != NULL && full != NULL);
+    diag_list editDiags, fullDiags;
+    diag_init(&editDiags);
+    diag_init(&fullDiags);
+    bool editOk = asm_document_edit(doc, first, removed, text, size, edited, &editDiags);
+    free(text);
+    CHECK(asm_document_lines(doc) == lineCount);
+
+    char* all;
+    size_t allSize = joinLines(&all, lines, lineCount, true);
+    CHECK(all != NULL);
+    *ok = assembleBuffer(all, allSize, options, full, &fullDiags);
+    free(all);
+
+    CHECK(editOk == *ok);
+    if (*ok){
+        static uint16_t editWords[MAX_WORDS], fullWords[MAX_WORDS];
+        CHECK(image_size(edited) <= MAX_WORDS && image_size(full) <= MAX_WORDS);
+        CHECK(edited->orig == full->orig);
+        size_t length = expand(edited, editWords);
+        CHECK(length == expand(full, fullWords));
+        CHECK(memcmp(editWords, fullWords, length * sizeof(uint16_t)) == 0);
+    } else {
+        CHECK(editDiags.length > 0 && fullDiags.length > 0);
+        CHECK(editDiags.items[0].code == fullDiags.items[0].code);
+        CHECK(editDiags.items[0].line == fullDiags.items[0].line);
+        CHECK(strcmp(editDiags.items[0].message, fullDiags.items[0].message) == 0);
+    }
+    diag_free(&editDiags);
+    diag_free(&fullDiags);
+    image_destroy(edited);
+    image_destroy(full);
+    return true;
+}
+
+// .ORIG, .END and most labelled lines are left in place, so edits mostly keep the program valid
+static bool keep(const char* line){
+    return strstr(line, ".ORIG") != NULL || strstr(line, ".END") != NULL
+        || (line[0] != ' ' && line[0] != ';' && line[0] != '\0' && randomBelow(4) != 0);
+}
+
+static bool randomEdits(const asm_options* options){
+    asm_document* doc = asm_document_create(options);
+    CHECK(doc != NULL);
+    lineCount = 0;
+    bool ok;
+    char* start[sizeof(program) / sizeof(program[0])];
+    for (size_t i = 0; i < sizeof(program) / sizeof(program[0]); ++i){
+        start[i] = (char*)program[i];
+    }
+    CHECK(edit(doc, options, 0, 0, start, sizeof(program) / sizeof(program[0]), &ok));
+    CHECK(ok);
+
+    int failed = 0;
+    for (int e = 0; e < EDITS; ++e){
+        size_t first = randomBelow((unsigned)lineCount + 1);
+        size_t removed = first < lineCount ? randomBelow(3) : 0;
+        if (removed > lineCount - first){
+            removed = lineCount - first;
+        }
+        for (size_t i = first; i < first + removed; ++i){
+            if (keep(lines[i])){
+                removed = 0;
+            }
+        }
+        char text[4][64];
+        char* inserted[4];
+        size_t count = randomBelow(4);
+        for (size_t i = 0; i < count; ++i){
+            snprintf(text[i], sizeof(text[i]), inserts[randomBelow(sizeof(inserts) / sizeof(inserts[0]))], nextLabel++);
+            inserted[i] = text[i];
+        }
+        char* saved[3];
+        for (size_t i = 0; i < removed; ++i){
+            saved[i] = copyLine(lines[first + i]);
+            CHECK(saved[i] != NULL);
+        }
+        CHECK(edit(doc, options, first, removed, inserted, count, &ok));
+        if (!ok){
+            failed++;
+            CHECK(edit(doc, options, first, count, saved, removed, &ok));
+            CHECK(ok);
+        }
+        for (size_t i = 0; i < removed; ++i){
+            free(saved[i]);
+        }
+    }
+    // most edits should have gone through the incremental path rather than the error one
+    CHECK(failed < EDITS / 2);
+    for (size_t i = 0; i < lineCount; ++i){
+        free(lines[i]);
+    }
+    asm_document_destroy(doc);
+    return true;
+}
+
+int main(void){
+    asm_options twoPass = {.passMode = TWO_PASS, .threads = 1};
+    asm_options singlePass = {.passMode = SINGLE_PASS, .threads = 1};
+    bool ok = randomEdits(&twoPass) && randomEdits(&singlePass);
+    printf("%s\n", ok ? "document tests passed" : "document tests failed");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+/*
+ht tests: gets and sets interleaved while the table grows, with incremental
+expansion on and off, checked against the keys that should be in the table.
+Exits 1 on the first failure.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "ht.h"
+
+#define KEYS 20000
+
+#define CHECK(cond) do { \
+    if (!(cond)){ \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        return false; \
+    } \
+} while (0)
+
+static int keyName(char* text, size_t size, int i, bool upper){
+    return snprintf(text, size, upper ? "Key_%X" : "key_%x", i);
+}
+
+static int* newValue(int value){
+    int* pValue = malloc(sizeof(int));
+    if (pValue != NULL){
+        *pValue = value;
+    }
+    return pValue;
+}
+
+// Key i, written in either case, must map to expected
+static bool checkKey(ht* table, int i, int expected){
+    char key[32];
+    keyName(key, sizeof(key), i, i % 2 == 1);
+    int* value = ht_get(table, key);
+    CHECK(value != NULL);
+    CHECK(*value == expected);
+    return true;
+}
+
+/*
+Add every key, looking up a few older ones after each set and all of them now and
+then, so lookups run while an expansion is part way through. Every tenth key is
+set again with a new value, which moves it if it hasn't been migrated yet.
+*/
+static bool fillAndCheck(bool incremental){
+    ht* table = ht_create();
+    CHECK(table != NULL);
+    ht_set_incremental(table, incremental);
+    static int expected[KEYS];
+    char key[32];
+    for (int i = 0; i < KEYS; ++i){
+        keyName(key, sizeof(key), i, false);
+        expected[i] = i * 3;
+        CHECK(ht_set(table, key, newValue(expected[i])) != NULL);
+        CHECK(ht_length(table) == (size_t)i + 1);
+        CHECK(checkKey(table, i, expected[i]));
+        CHECK(checkKey(table, i / 2, expected[i / 2]));
+        if (i % 10 == 0 && i > 0){
+            int old = i / 3;
+            keyName(key, sizeof(key), old, true);
+            int* previous = ht_get(table, key);
+            CHECK(previous != NULL);
+            expected[old] = -old;
+            CHECK(ht_set(table, key, newValue(expected[old])) != NULL);
+            free(previous);
+            CHECK(ht_length(table) == (size_t)i + 1);
+        }
+        if (i % 1009 == 0){
+            for (int k = 0; k <= i; ++k){
+                CHECK(checkKey(table, k, expected[k]));
+            }
+        }
+        keyName(key, sizeof(key), i + KEYS, false);
+        CHECK(ht_get(table, key) == NULL);
+    }
+
+    ht_stats stats;
+    ht_info(table, &stats);
+    CHECK(stats.length == KEYS);
+    CHECK(stats.expansions > 0);
+    CHECK(stats.mean_probe >= 1);
+
+    size_t seen = 0;
+    hti it = ht_iterator(table);
+    while (ht_next(&it)){
+        unsigned i = 0;
+        CHECK(sscanf(it.key, "key_%x", &i) == 1);
+        CHECK(i < KEYS);
+        CHECK(*(int*)it.value == expected[i]);
+        seen++;
+    }
+    CHECK(seen == KEYS);
+    ht_destroy(table);
+    return true;
+}
+
+// Inline values in an arena table, with keys that aren't NUL-terminated and incremental turned off part way
+static bool arenaInts(void){
+    arena* a = arena_create();
+    CHECK(a != NULL);
+    ht* table = ht_create_arena(a);
+    CHECK(table != NULL);
+    ht_set_incremental(table, true);
+    char text[64];
+    for (int i = 0; i < KEYS; ++i){
+        int length = keyName(text, sizeof(text), i, i % 3 == 0);
+        text[length] = '!'; // only the first length bytes are the key
+        CHECK(ht_setn_int(table, text, length, i) != NULL);
+        int value = -1;
+        CHECK(ht_getn_int(table, text, length, &value) && value == i);
+        if (i == KEYS / 2 + 7){
+            ht_set_incremental(table, false);
+        }
+    }
+    for (int i = 0; i < KEYS; ++i){
+        int length = keyName(text, sizeof(text), i, false);
+        int value = -1;
+        CHECK(ht_getn_int(table, text, length, &value) && value == i);
+    }
+    CHECK(ht_length(table) == KEYS);
+    ht_destroy(table);
+    arena_destroy(a);
+    return true;
+}
+
+int main(void){
+    bool ok = fillAndCheck(false) && fillAndCheck(true) && arenaInts();
+    printf("%s\n", ok ? "ht tests passed" : "ht tests failed");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/*
+symtab tests: several threads intern overlapping labels at once and define them,
+then the table is frozen and checked against what interning the same labels one
+at a time gives. Exits 1 on the first failure.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "symtab.h"
+
+#define THREADS 8
+#define KEYS 3000
+#define BEFORE 100 // labels interned the ordinary way before sharing
+#define ROUNDS 20
+#define KEY_LENGTH 16
+
+#define CHECK(cond) do { \
+    if (!(cond)){ \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        return false; \
+    } \
+} while (0)
+
+typedef struct {
+    symtab* table;
+    int thread;
+    char keys[KEYS][KEY_LENGTH]; // this thread's spelling of every label, interned without being copied
+    int32_t ids[KEYS];           // id the thread got for every label, -2 if it didn't intern it
+    int round;                   // rounds run before this one
+    int added;                   // symbols this thread was the one to define
+} worker;
+
+static worker workers[THREADS];
+static atomic_int ready;
+
+// Label i, with the case of its letters picked by the thread so keys only match ignoring case
+static void keyName(char* text, int i, int thread){
+    snprintf(text, KEY_LENGTH, "lbl_%d_x", i);
+    for (int k = 0; text[k] != '\0'; ++k){
+        if (text[k] >= 'a' && text[k] <= 'z' && ((i + k + thread) & 1)){
+            text[k] -= 'a' - 'A';
+        }
+    }
+}
+
+// Wait until every thread is here, so they really do intern at the same time
+static void startTogether(int round){
+    atomic_fetch_add(&ready, 1);
+    while (atomic_load(&ready) < THREADS * (round + 1)){
+        sched_yield();
+    }
+}
+
+// Intern the labels in an order of this thread's own, each thread covers most of them
+static void* internLabels(void* arg){
+    worker* w = arg;
+    for (int i = 0; i < KEYS; ++i){
+        keyName(w->keys[i], i, w->thread);
+        w->ids[i] = -2;
+    }
+    startTogether(w->round);
+    for (int n = 0; n < KEYS; ++n){
+        int i = (n * 7 + w->thread * (KEYS / THREADS)) % KEYS;
+        if ((i + w->thread) % 5 != 0){ // every label is left out by some threads
+            w->ids[i] = symtab_intern_shared(w->table, w->keys[i], strlen(w->keys[i]));
+        }
+    }
+    return NULL;
+}
+
+// Define every label, which each thread tries, only one may get SYM_ADDED
+static void* defineLabels(void* arg){
+    worker* w = arg;
+    for (int n = 0; n < KEYS; ++n){
+        int i = (n * 11 + w->thread * 13) % KEYS;
+        if (w->ids[i] >= 0 && symtab_define(w->table, w->ids[i], (uint16_t)(i * 2)) == SYM_ADDED){
+            w->added++;
+        }
+    }
+    return NULL;
+}
+
+static bool runThreads(void* (*task)(void*)){
+    pthread_t threads[THREADS];
+    for (int t = 0; t < THREADS; ++t){
+        CHECK(pthread_create(&threads[t], NULL, task, &workers[t]) == 0);
+    }
+    for (int t = 0; t < THREADS; ++t){
+        pthread_join(threads[t], NULL);
+    }
+    return true;
+}
+
+static bool sharedRound(symtab* table, int round){
+    char key[KEY_LENGTH];
+    // a few labels are in the table before sharing starts and keep their ids
+    for (int i = 0; i < BEFORE; ++i){
+        keyName(key, KEYS + i, 0);
+        CHECK(symtab_intern(table, key, strlen(key)) == i);
+    }
+    CHECK(symtab_share(table, KEYS));
+    for (int t = 0; t < THREADS; ++t){
+        workers[t].table = table;
+        workers[t].thread = t;
+        workers[t].round = round;
+        workers[t].added = 0;
+    }
+    CHECK(runThreads(internLabels));
+
+    // every thread that interned a label got the same id, and no two labels share one
+    static int32_t ids[KEYS];
+    static bool used[KEYS + BEFORE];
+    memset(used, 0, sizeof(used));
+    for (int i = 0; i < KEYS; ++i){
+        ids[i] = -1;
+        for (int t = 0; t < THREADS; ++t){
+            int32_t id = workers[t].ids[i];
+            if (id == -2){
+                continue;
+            }
+            CHECK(id >= BEFORE && id < KEYS + BEFORE);
+            CHECK(ids[i] == -1 || ids[i] == id);
+            ids[i] = id;
+        }
+        CHECK(ids[i] >= 0);
+        CHECK(!used[ids[i]]);
+        used[ids[i]] = true;
+    }
+
+    // freezing copies the keys, so the threads' spellings can go
+    CHECK(symtab_freeze(table));
+    CHECK(symtab_length(table) == KEYS + BEFORE);
+    for (int t = 0; t < THREADS; ++t){
+        memset(workers[t].keys, '?', sizeof(workers[t].keys));
+    }
+    for (int i = 0; i < KEYS; ++i){
+        keyName(key, i, 1);
+        CHECK(symtab_intern(table, key, strlen(key)) == ids[i]);
+    }
+    for (int i = 0; i < BEFORE; ++i){
+        keyName(key, KEYS + i, 1);
+        CHECK(symtab_intern(table, key, strlen(key)) == i);
+    }
+
+    CHECK(runThreads(defineLabels));
+    int added = 0;
+    for (int t = 0; t < THREADS; ++t){
+        added += workers[t].added;
+    }
+    CHECK(added == KEYS);
+    for (int i = 0; i < KEYS; ++i){
+        uint16_t address;
+        keyName(key, i, 2);
+        CHECK(symtab_get(table, key, strlen(key), &address) && address == (uint16_t)(i * 2));
+    }
+    keyName(key, 0, 0);
+    CHECK(symtab_add(table, key, strlen(key), 1) == SYM_EXISTS);
+    return true;
+}
+
+// The same labels interned one at a time must end up with the same symbols and addresses
+static bool matchesSequential(symtab* shared){
+    arena* keys = arena_create();
+    symtab* table = keys != NULL ? symtab_create(keys) : NULL;
+    CHECK(table != NULL);
+    char key[KEY_LENGTH];
+    for (int i = 0; i < KEYS; ++i){
+        keyName(key, i, 3);
+        CHECK(symtab_add(table, key, strlen(key), (uint16_t)(i * 2)) == SYM_ADDED);
+    }
+    for (int i = 0; i < KEYS; ++i){
+        uint16_t expected, address;
+        keyName(key, i, 4);
+        CHECK(symtab_get(table, key, strlen(key), &expected));
+        CHECK(symtab_get(shared, key, strlen(key), &address) && address == expected);
+    }
+    // the table filled up on the way, but sizing it up front isn't an expansion
+    ht_stats stats;
+    symtab_info(table, &stats);
+    CHECK(stats.expansions > 0);
+    symtab_clear(table);
+    CHECK(symtab_reserve(table, 4 * KEYS));
+    for (int i = 0; i < KEYS; ++i){
+        keyName(key, i, 5);
+        CHECK(symtab_add(table, key, strlen(key), (uint16_t)i) == SYM_ADDED);
+    }
+    size_t before = stats.expansions;
+    symtab_info(table, &stats);
+    CHECK(stats.expansions == before);
+    symtab_destroy(table);
+    arena_destroy(keys);
+    return true;
+}
+
+// Interning past the room symtab_share made fails instead of filling the table
+static bool sharedLimit(void){
+    arena* keys = arena_create();
+    symtab* table = keys != NULL ? symtab_create(keys) : NULL;
+    CHECK(table != NULL);
+    CHECK(symtab_share(table, 10));
+    char key[KEYS][KEY_LENGTH];
+    int failed = 0;
+    for (int i = 0; i < KEYS; ++i){
+        keyName(key[i], i, 0);
+        int32_t id = symtab_intern_shared(table, key[i], strlen(key[i]));
+        CHECK(id >= -1 && id < KEYS);
+        failed += id < 0;
+    }
+    CHECK(failed > 0);
+    CHECK(symtab_freeze(table));
+    CHECK(symtab_length(table) == (size_t)(KEYS - failed));
+    symtab_destroy(table);
+    arena_destroy(keys);
+    return true;
+}
+
+int main(void){
+    arena* keys = arena_create();
+    symtab* table = keys != NULL ? symtab_create(keys) : NULL;
+    bool ok = table != NULL;
+    for (int round = 0; ok && round < ROUNDS; ++round){
+        symtab_clear(table);
+        ok = sharedRound(table, round);
+    }
+    ok = ok && matchesSequential(table) && sharedLimit();
+    if (table != NULL){
+        symtab_destroy(table);
+    }
+    arena_destroy(keys);
+    printf("%s\n", ok ? "symtab tests passed" : "symtab tests failed");
+    return ok ? 0 : 1;
+}